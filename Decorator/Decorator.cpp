@@ -1,6 +1,11 @@
 #include "doctest.h"
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
 
 //Example presenting Astro Subscriber Interface
 
@@ -60,11 +65,34 @@ TEST_CASE("Check this awesome subscriber interface!!!" * doctest::skip())
 
 namespace DecoratorDesign {
 
+class Window;
+
+//One step of a compiled window - a plain function pointer, no virtual call when it runs
+struct RenderStep
+{
+    void (*run)(Window&);
+    Window* window;
+};
+
 class Window
 {
 public:
     virtual ~Window() = default;
     virtual void show() = 0;
+
+    //appends the steps show() consists of - by default the whole show() is one step
+    virtual void compile(std::vector<RenderStep>& steps)
+    {
+        steps.push_back({[](Window& window) { window.show(); }, this});
+    }
+
+protected:
+    //step which doesn't need the window itself, e.g. a decoration
+    template<void (*Decoration)()>
+    static RenderStep step(Window* self)
+    {
+        return {[](Window&) { Decoration(); }, self};
+    }
 };
 
 //Object that is least common denominator
@@ -83,39 +111,188 @@ public:
     {
         base->show();
     }
+
+    //compile() stays Window's - one step running show() - so a decorator which overrides just
+    //show() compiles right; the ones below flatten themselves around compileBase()
+
+protected:
+    void compileBase(std::vector<RenderStep>& steps)
+    {
+        base->compile(steps);
+    }
+};
+
+//The decorations as stateless layers, for Decorated and for the compiled steps
+struct ScrollbarLayer
+{
+    static void addScrollbar() { std::cout << "Adding scrollbar\n"; }
+
+    template<typename Inner>
+    static void showAround(Inner&& showInner)
+    {
+        showInner();
+        addScrollbar();
+    }
+};
+
+struct CurrentDateLayer
+{
+    static void addCurrentDate() { std::cout << "Adding current date\n"; }
+
+    template<typename Inner>
+    static void showAround(Inner&& showInner)
+    {
+        showInner();
+        addCurrentDate();
+    }
+};
+
+struct WarningMessageLayer
+{
+    static void welcome() { std::cout << "Welcome!\n"; }
+
+    template<typename Inner>
+    static void showAround(Inner&& showInner)
+    {
+        welcome();
+        showInner();
+    }
 };
 
 class Scrollbar : public Decorator
 {
 public:
+    using Layer = ScrollbarLayer;
+
     Scrollbar(Window* parent) : Decorator(parent) {}
     void show() override
     {
         Decorator::show();
         std::cout << "Adding scrollbar\n";
     }
+
+    void compile(std::vector<RenderStep>& steps) override
+    {
+        compileBase(steps);
+        steps.push_back(step<&Layer::addScrollbar>(this));
+    }
 };
 
 class CurrentDate : public Decorator
 {
 public:
+    using Layer = CurrentDateLayer;
+
     CurrentDate(Window* parent) : Decorator(parent) {}
     void show() override
     {
         Decorator::show();
         std::cout << "Adding current date\n";
     }
+
+    void compile(std::vector<RenderStep>& steps) override
+    {
+        compileBase(steps);
+        steps.push_back(step<&Layer::addCurrentDate>(this));
+    }
 };
 
 class WarningMessage : public Decorator
 {
 public:
+    using Layer = WarningMessageLayer;
+
     WarningMessage(Window* parent) : Decorator(parent) {}
     void show() override
     {
         std::cout << "Welcome!\n";
         Decorator::show();
     }
+
+    void compile(std::vector<RenderStep>& steps) override
+    {
+        steps.push_back(step<&Layer::welcome>(this));
+        compileBase(steps);
+    }
+};
+
+//Decorator chain walked once and flattened into an array of steps: every decoration's part
+//before and after the window it decorates, in the order show() would run them. Showing it is
+//a loop over the array - no recursion and no virtual call per layer, however deep the chain.
+//Like the decorators, it refers to the chain and must not outlive it; after the chain is
+//changed, compile it again.
+class CompiledWindow : public Window
+{
+    std::vector<RenderStep> steps;
+public:
+    explicit CompiledWindow(Window& chain)
+    {
+        chain.compile(steps);
+    }
+
+    void show() override
+    {
+        for(const auto& step : steps)
+        {
+            step.run(*step.window);
+        }
+    }
+
+    void compile(std::vector<RenderStep>& into) override
+    {
+        into.insert(into.end(), steps.begin(), steps.end());
+    }
+
+    size_t size() const { return steps.size(); }
+};
+
+//Layout fixed at compile time: Decorated<SubscriberLcd, Scrollbar, CurrentDate, WarningMessage>
+//shows the same as WarningMessage(CurrentDate(Scrollbar(SubscriberLcd))), but the window is a
+//member and the decorations' layers are called directly - the compiler sees the whole show()
+//and can inline it. A layer is given either as a runtime decorator or as its Layer struct,
+//e.g. Decorated<SubscriberLcd, ScrollbarLayer>. It is still a Window, so it can be decorated at
+//run time, compiled, or used wherever a Window is expected.
+template<typename Decoration, typename = void>
+struct LayerOf
+{
+    using type = Decoration;
+};
+
+template<typename Decoration>
+struct LayerOf<Decoration, std::void_t<typename Decoration::Layer>>
+{
+    using type = typename Decoration::Layer;
+};
+
+template<typename Core, typename... Layers>
+class Decorated final : public Window
+{
+    static_assert(std::is_base_of_v<Window, Core>, "Decorated window must be a Window");
+
+    Core core;
+
+    //shows the core with the innermost Count layers around it
+    template<size_t Count>
+    void showLayers()
+    {
+        if constexpr(Count == 0)
+        {
+            core.Core::show();
+        }
+        else
+        {
+            using Layer = typename LayerOf<std::tuple_element_t<Count - 1, std::tuple<Layers...>>>::type;
+            Layer::showAround([this] { showLayers<Count - 1>(); });
+        }
+    }
+
+public:
+    void show() override
+    {
+        showLayers<sizeof...(Layers)>();
+    }
+
+    Core& window() { return core; }
 };
 
 TEST_CASE("Typical usage of an decorator")
@@ -130,4 +307,120 @@ TEST_CASE("Typical usage of an decorator")
     astroLcd->show();
 }
 
+std::string shownBy(Window& window)
+{
+    std::ostringstream output;
+    auto* original = std::cout.rdbuf(output.rdbuf());
+    window.show();
+    std::cout.rdbuf(original);
+    return output.str();
+}
+
+TEST_CASE("Compiled decorator chain shows the same as the chain")
+{
+    SubscriberLcd subLcd;
+    Scrollbar scrollbar(&subLcd);
+    CurrentDate currentDate(&scrollbar);
+    WarningMessage warningMessage(&currentDate);
+
+    CompiledWindow astroLcd(warningMessage);
+
+    CHECK(astroLcd.size() == 4);
+    CHECK(shownBy(astroLcd) == shownBy(warningMessage));
+    CHECK(shownBy(astroLcd) == "Welcome!\nShowing subscriber lcd.\nAdding scrollbar\nAdding current date\n");
+}
+
+TEST_CASE("Deep decorator chain is flattened into one step per decoration")
+{
+    SubscriberLcd subLcd;
+    std::vector<std::unique_ptr<Window>> chain;
+    Window* top = &subLcd;
+    for(int layer = 0; layer < 48; ++layer)
+    {
+        switch(layer % 4)
+        {
+        case 0: chain.push_back(std::make_unique<Scrollbar>(top)); break;
+        case 1: chain.push_back(std::make_unique<WarningMessage>(top)); break;
+        case 2: chain.push_back(std::make_unique<CurrentDate>(top)); break;
+        case 3: chain.push_back(std::make_unique<Scrollbar>(top)); break;
+        }
+        top = chain.back().get();
+    }
+
+    CompiledWindow compiled(*top);
+
+    //one step per decoration, plus the lcd itself
+    CHECK(compiled.size() == 48 + 1);
+    CHECK(shownBy(compiled) == shownBy(*top));
+
+    //a compiled window can be decorated and compiled again
+    Scrollbar outer(&compiled);
+    CompiledWindow recompiled(outer);
+    CHECK(recompiled.size() == compiled.size() + 1);
+    CHECK(shownBy(recompiled) == shownBy(outer));
+}
+
+//decorator written the usual way, overriding just show()
+class CurrentChannel : public Decorator
+{
+public:
+    CurrentChannel(Window* parent) : Decorator(parent) {}
+    void show() override
+    {
+        Decorator::show();
+        std::cout << "Adding channel\n";
+    }
+};
+
+TEST_CASE("Decorator overriding just show() is compiled as a single step")
+{
+    SubscriberLcd subLcd;
+    Scrollbar scrollbar(&subLcd);
+    CurrentChannel currentChannel(&scrollbar);
+    WarningMessage warningMessage(&currentChannel);
+
+    CompiledWindow compiled(warningMessage);
+
+    CHECK(compiled.size() == 2);
+    CHECK(shownBy(compiled) == shownBy(warningMessage));
+    CHECK(shownBy(compiled) == "Welcome!\nShowing subscriber lcd.\nAdding scrollbar\nAdding channel\n");
+}
+
+TEST_CASE("Decorated layout shows the same as the runtime chain")
+{
+    SubscriberLcd subLcd;
+    Scrollbar scrollbar(&subLcd);
+    CurrentDate currentDate(&scrollbar);
+    WarningMessage warningMessage(&currentDate);
+
+    Decorated<SubscriberLcd, Scrollbar, CurrentDate, WarningMessage> astroLcd;
+
+    CHECK(shownBy(astroLcd) == shownBy(warningMessage));
+
+    //the same decoration twice is fine too
+    Decorated<SubscriberLcd, Scrollbar, Scrollbar> doubleScrollbar;
+    CHECK(shownBy(doubleScrollbar) == "Showing subscriber lcd.\nAdding scrollbar\nAdding scrollbar\n");
+
+    //layers can be given directly, and carry no state
+    Decorated<SubscriberLcd, ScrollbarLayer, CurrentDateLayer, WarningMessageLayer> fromLayers;
+    CHECK(shownBy(fromLayers) == shownBy(warningMessage));
+    CHECK(sizeof(fromLayers) == sizeof(Decorated<SubscriberLcd>));
+    static_assert(!std::is_default_constructible_v<Scrollbar>, "runtime decorators need a window to decorate");
+}
+
+TEST_CASE("Decorated layout works with runtime decorators")
+{
+    Decorated<SubscriberLcd, Scrollbar, CurrentDate> fixedPart;
+
+    //decorated further at run time
+    WarningMessage warningMessage(&fixedPart);
+    Window* astroLcd = &warningMessage;
+    CHECK(shownBy(*astroLcd) == "Welcome!\nShowing subscriber lcd.\nAdding scrollbar\nAdding current date\n");
+
+    //and compiled, where the whole fixed part is a single step
+    CompiledWindow compiled(warningMessage);
+    CHECK(compiled.size() == 2);
+    CHECK(shownBy(compiled) == shownBy(*astroLcd));
+}
+
 }
@@ -0,0 +1,839 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <string>
+#include <cstdint>
+
+#include "TickGenerator.h"
+
+//Observer with asynchronous dispatch
+//
+//In the basic Observer every NotificationChannel is notified inline, on the thread calling
+//Stock::setValue(). One slow channel (e.g. SmsNotification talking to a gateway) stalls
+//every price update. Here each subscription can be:
+//
+//Inline - notified directly from setValue(), as before
+//Queued - setValue() only pushes the value into a lock-free queue owned by the subscription,
+//         the channel is notified later by a worker of the DispatchPool
+//
+//A queued subscription is bounded, its Backpressure policy decides what happens when the
+//channel can't keep up:
+//
+//Block      - setValue() waits for free space, nothing is lost (Buzzer must never miss a trigger)
+//DropNewest - the incoming value is discarded
+//DropOldest - the oldest queued value is discarded to make room (LcdScreen can drop frames)
+//Conflate   - the subscription keeps only the latest value. A slow consumer (LcdScreen refreshing
+//             at 60 Hz while the Stock ticks at 100 kHz) gets the most recent price whenever it
+//             is ready for the next one, stale prices are simply overwritten
+//
+//Dropped and delayed notifications are counted per subscription.
+//
+//Each queued subscription is drained by exactly one worker, so its queue has a single producer
+//(the thread calling setValue()) and a single consumer (the worker) and needs no locks.
+
+namespace AsyncObserver {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Updating LcdScreen\n";
+    }
+};
+
+class Buzzer : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Triggering Buzzer\n";
+    }
+};
+
+class SmsNotification : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        //pretend we are waiting for the SMS gateway
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::cout << "Sending SmsNotification\n";
+    }
+};
+
+enum class Dispatch
+{
+    Inline,
+    Queued
+};
+
+enum class Backpressure
+{
+    Block,
+    DropNewest,
+    DropOldest,
+    Conflate
+};
+
+//Bounded single producer / single consumer queue.
+//head and tail live on separate cache lines, so producer and consumer don't fight over them.
+//head is advanced with CAS, so the producer may also evict the oldest element (DropOldest);
+//slots are atomic because the consumer may read a slot the producer is just overwriting -
+//such a read is then thrown away by the failed CAS.
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity)
+        : size(roundUp(capacity)), mask(size - 1), slots(new std::atomic<double>[size]) {}
+
+    bool push(double value)
+    {
+        const auto t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) == size)
+        {
+            return false;
+        }
+        slots[t & mask].store(value, std::memory_order_relaxed);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(double& value)
+    {
+        auto h = head.load(std::memory_order_acquire);
+        for(;;)
+        {
+            if(h == tail.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            value = slots[h & mask].load(std::memory_order_relaxed);
+            if(head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                return true;
+            }
+        }
+    }
+
+    //producer side only - drops the oldest element, returns false if the consumer emptied the queue first
+    bool evictOldest()
+    {
+        double ignored;
+        return pop(ignored);
+    }
+
+    size_t capacity() const { return size; }
+
+private:
+    static size_t roundUp(size_t n)
+    {
+        size_t result = 1;
+        while(result < n)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const size_t size;
+    const size_t mask;
+    std::unique_ptr<std::atomic<double>[]> slots;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+//Latest value slot, as a triple buffer: the producer and the consumer own one buffer each, the
+//third one is in the middle word together with the "dirty" flag. Publishing swaps the producer's
+//buffer into the middle and taking swaps it out to the consumer, each in one atomic exchange,
+//so every published value is either consumed exactly once or overwritten by a newer one.
+//Any double is a valid value, NaN included.
+class LatestValueMailbox
+{
+public:
+    //returns false if an unconsumed value has been overwritten
+    bool put(double value)
+    {
+        buffers[back] = value;
+        const auto previous = middle.exchange(back | dirty, std::memory_order_acq_rel);
+        back = previous & indexMask;
+        return !(previous & dirty);
+    }
+
+    bool take(double& value)
+    {
+        if(!(middle.load(std::memory_order_acquire) & dirty))
+        {
+            return false;
+        }
+        //only take() clears the flag, so the value is still there
+        front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+        value = buffers[front];
+        return true;
+    }
+
+private:
+    static constexpr unsigned indexMask = 3;
+    static constexpr unsigned dirty = 4;
+
+    double buffers[3] = {};
+    unsigned back = 0;                      //producer's buffer
+    unsigned front = 1;                     //consumer's buffer
+    std::atomic<unsigned> middle{2};
+};
+
+class Subscription
+{
+public:
+    Subscription(std::shared_ptr<NotificationChannel> theChannel, Dispatch theMode,
+                 Backpressure thePolicy, size_t queueCapacity)
+        : channel(std::move(theChannel)), mode(theMode), policy(thePolicy), queue(queueCapacity) {}
+
+    //called by the thread calling Stock::setValue()
+    void publish(double value)
+    {
+        if(mode == Dispatch::Inline)
+        {
+            channel->notify(value);
+            delivered.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        switch(policy)
+        {
+        case Backpressure::Block:
+            if(!queue.push(value))
+            {
+                delayed.fetch_add(1, std::memory_order_relaxed);
+                while(!queue.push(value))
+                {
+                    std::this_thread::yield();
+                }
+            }
+            break;
+        case Backpressure::DropNewest:
+            if(!queue.push(value))
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            break;
+        case Backpressure::DropOldest:
+            while(!queue.push(value))
+            {
+                if(queue.evictOldest())
+                {
+                    enqueued.fetch_sub(1, std::memory_order_relaxed);
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            break;
+        case Backpressure::Conflate:
+            if(!mailbox.put(value))
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            break;
+        }
+        enqueued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //called by the worker owning this subscription, returns number of notifications
+    size_t drain(size_t maxBatch)
+    {
+        size_t count = 0;
+        double value;
+        if(policy == Backpressure::Conflate)
+        {
+            if(mailbox.take(value))
+            {
+                channel->notify(value);
+                delivered.fetch_add(1, std::memory_order_release);
+                ++count;
+            }
+            return count;
+        }
+        while(count < maxBatch && queue.pop(value))
+        {
+            channel->notify(value);
+            delivered.fetch_add(1, std::memory_order_release);
+            ++count;
+        }
+        return count;
+    }
+
+    bool idle() const
+    {
+        return mode == Dispatch::Inline
+            || enqueued.load(std::memory_order_relaxed) == delivered.load(std::memory_order_acquire);
+    }
+
+    const std::shared_ptr<NotificationChannel>& getChannel() const { return channel; }
+    Dispatch getMode() const { return mode; }
+    Backpressure getPolicy() const { return policy; }
+    bool isAsync() const { return mode != Dispatch::Inline; }
+    size_t getDelivered() const { return delivered.load(std::memory_order_relaxed); }
+    size_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+    size_t getDelayed() const { return delayed.load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<NotificationChannel> channel;
+    const Dispatch mode;
+    const Backpressure policy;
+    SpscQueue queue;
+    LatestValueMailbox mailbox;
+    std::atomic<size_t> enqueued{0};
+    std::atomic<size_t> delivered{0};
+    std::atomic<size_t> dropped{0};
+    std::atomic<size_t> delayed{0};
+};
+
+//Worker threads draining queued subscriptions.
+//The mutexes guard only the per-worker subscription lists and are never touched by setValue().
+//A worker notifies from its own copy of the list, refreshed when the list changes, so attach()
+//and detach() never wait for a slow channel; a channel detached while it is being notified may
+//still get the values the worker has already taken for it.
+class DispatchPool
+{
+public:
+    explicit DispatchPool(size_t threads = std::thread::hardware_concurrency())
+        : workers(std::max<size_t>(threads, 1))
+    {
+        for(auto& worker : workers)
+        {
+            worker.thread = std::thread([this, &worker] { run(worker); });
+        }
+    }
+
+    ~DispatchPool()
+    {
+        stopping.store(true);
+        for(auto& worker : workers)
+        {
+            worker.thread.join();
+        }
+    }
+
+    DispatchPool(const DispatchPool&) = delete;
+    DispatchPool& operator=(const DispatchPool&) = delete;
+
+    void add(std::shared_ptr<Subscription> subscription)
+    {
+        auto& worker = workers[next++ % workers.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.subscriptions.push_back(std::move(subscription));
+        ++worker.version;
+    }
+
+    void remove(const std::shared_ptr<Subscription>& subscription)
+    {
+        for(auto& worker : workers)
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            auto& subs = worker.subscriptions;
+            subs.erase(std::remove(subs.begin(), subs.end(), subscription), subs.end());
+            ++worker.version;
+        }
+    }
+
+    //blocks until every queued value has been delivered - useful in tests and at shutdown
+    void waitIdle()
+    {
+        for(auto& worker : workers)
+        {
+            for(;;)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(worker.mutex);
+                    if(std::all_of(worker.subscriptions.begin(), worker.subscriptions.end(),
+                                   [](const std::shared_ptr<Subscription>& s) { return s->idle(); }))
+                    {
+                        break;
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    struct Worker
+    {
+        std::thread thread;
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Subscription>> subscriptions;
+        std::uint64_t version = 0;      //bumped on every change of subscriptions
+    };
+
+    void run(Worker& worker)
+    {
+        const size_t maxBatch = 64;
+        size_t idleRounds = 0;
+        std::vector<std::shared_ptr<Subscription>> draining;
+        std::uint64_t drainingVersion = 0;
+        while(!stopping.load(std::memory_order_relaxed))
+        {
+            {
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                if(worker.version != drainingVersion)
+                {
+                    draining = worker.subscriptions;
+                    drainingVersion = worker.version;
+                }
+            }
+            size_t done = 0;
+            for(auto& subscription : draining)
+            {
+                done += subscription->drain(maxBatch);
+            }
+            if(done)
+            {
+                idleRounds = 0;
+            }
+            else if(++idleRounds < 100)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    }
+
+    std::vector<Worker> workers;
+    size_t next = 0;
+    std::atomic<bool> stopping{false};
+};
+
+class Stock
+{
+private:
+    double value;
+    std::shared_ptr<DispatchPool> pool;     //shared, the Stock leaves it when destroyed
+    std::vector<std::shared_ptr<Subscription>> observers;
+public:
+    Stock() = default;
+    explicit Stock(std::shared_ptr<DispatchPool> dispatchPool) : pool(std::move(dispatchPool)) {}
+
+    ~Stock()
+    {
+        for(auto& observer : observers)
+        {
+            if(observer->isAsync())
+            {
+                pool->remove(observer);
+            }
+        }
+    }
+
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer->publish(value);
+        }
+    }
+
+    std::shared_ptr<Subscription> attach(std::shared_ptr<NotificationChannel> newObserver,
+                                         Dispatch mode = Dispatch::Inline,
+                                         Backpressure policy = Backpressure::DropNewest,
+                                         size_t queueCapacity = 1024)
+    {
+        if(mode != Dispatch::Inline && !pool)
+        {
+            throw std::logic_error("Asynchronous dispatch requires a Stock constructed with a DispatchPool");
+        }
+        const bool needsQueue = mode == Dispatch::Queued && policy != Backpressure::Conflate;
+        auto subscription = std::make_shared<Subscription>(std::move(newObserver), mode, policy,
+                                                           needsQueue ? queueCapacity : 1);
+        observers.push_back(subscription);
+        if(subscription->isAsync())
+        {
+            pool->add(subscription);
+        }
+        return subscription;
+    }
+
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        auto matches = [&observer](const std::shared_ptr<Subscription>& s) { return s->getChannel() == observer; };
+        for(auto& subscription : observers)
+        {
+            if(matches(subscription) && subscription->isAsync())
+            {
+                pool->remove(subscription);
+            }
+        }
+        observers.erase(std::remove_if(observers.begin(), observers.end(), matches), observers.end());
+    }
+
+    void setValue(double newValue)
+    {
+        //just for test purposes
+        value = newValue;
+        valueChanged();
+    }
+};
+
+TEST_CASE("Slow SmsNotification doesn't stall setValue when queued" * doctest::skip())
+{
+    auto pool = std::make_shared<DispatchPool>(2);
+    Stock motoStock(pool);
+
+    motoStock.attach(std::make_shared<LcdScreen>());
+    motoStock.attach(std::make_shared<Buzzer>());
+    motoStock.attach(std::make_shared<SmsNotification>(), Dispatch::Queued);
+
+    motoStock.setValue(1.0);
+    motoStock.setValue(5.1);
+
+    pool->waitIdle();
+}
+
+class CountingChannel : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        last = value;
+        ++count;
+    }
+    double last = 0.0;
+    size_t count = 0;
+};
+
+TEST_CASE("Queued channels receive every value in order")
+{
+    struct OrderCheckingChannel : public NotificationChannel
+    {
+        void notify(double value) override
+        {
+            inOrder = inOrder && value > last;
+            last = value;
+            ++count;
+        }
+        double last = 0.0;
+        size_t count = 0;
+        bool inOrder = true;
+    };
+
+    auto pool = std::make_shared<DispatchPool>(2);
+    auto inlineChannel = std::make_shared<CountingChannel>();
+    auto queuedChannel = std::make_shared<OrderCheckingChannel>();
+    {
+        Stock stock(pool);
+        stock.attach(inlineChannel);
+        auto subscription = stock.attach(queuedChannel, Dispatch::Queued, Backpressure::DropNewest, 1 << 16);
+
+        for(int i = 1; i <= 10000; ++i)
+        {
+            stock.setValue(i);
+        }
+        pool->waitIdle();
+
+        CHECK(subscription->getDropped() == 0);
+    }
+
+    CHECK(inlineChannel->count == 10000);
+    CHECK(queuedChannel->count == 10000);
+    CHECK(queuedChannel->inOrder);
+    CHECK(queuedChannel->last == 10000.0);
+}
+
+TEST_CASE("Attach and detach don't wait for a slow queued channel")
+{
+    struct StuckChannel : public NotificationChannel
+    {
+        void notify(double value) override
+        {
+            entered.store(true);
+            while(!released.load())
+            {
+                std::this_thread::yield();
+            }
+        }
+        std::atomic<bool> entered{false};
+        std::atomic<bool> released{false};
+    };
+
+    auto pool = std::make_shared<DispatchPool>(1);
+    auto stuck = std::make_shared<StuckChannel>();
+    auto other = std::make_shared<CountingChannel>();
+    Stock stock(pool);
+    stock.attach(stuck, Dispatch::Queued);
+    stock.setValue(1.0);
+    while(!stuck->entered.load())
+    {
+        std::this_thread::yield();
+    }
+
+    //the worker is inside stuck->notify(), these would wait for it if it held the list locked
+    stock.attach(other, Dispatch::Queued);
+    stock.detach(stuck);
+    stock.detach(other);
+
+    stuck->released.store(true);
+    pool->waitIdle();
+}
+
+TEST_CASE("Full queue drops values instead of blocking setValue")
+{
+    struct BlockedChannel : public NotificationChannel
+    {
+        void notify(double value) override
+        {
+            while(!released.load())
+            {
+                std::this_thread::yield();
+            }
+        }
+        std::atomic<bool> released{false};
+    };
+
+    auto pool = std::make_shared<DispatchPool>(1);
+    auto channel = std::make_shared<BlockedChannel>();
+    Stock stock(pool);
+    auto subscription = stock.attach(channel, Dispatch::Queued, Backpressure::DropNewest, 4);
+
+    for(int i = 0; i < 100; ++i)
+    {
+        stock.setValue(i);
+    }
+    channel->released.store(true);
+    pool->waitIdle();
+
+    CHECK(subscription->getDropped() > 0);
+    CHECK(subscription->getDelivered() + subscription->getDropped() == 100);
+}
+
+TEST_CASE("Backpressure policies of an overloaded channel")
+{
+    struct GatedChannel : public NotificationChannel
+    {
+        void notify(double value) override
+        {
+            while(!released.load())
+            {
+                std::this_thread::yield();
+            }
+            values.push_back(value);
+        }
+        std::atomic<bool> released{false};
+        std::vector<double> values;
+    };
+
+    auto pool = std::make_shared<DispatchPool>(1);
+    auto channel = std::make_shared<GatedChannel>();
+    Stock stock(pool);
+
+    SUBCASE("Block never loses a value, but delays the publisher")
+    {
+        auto subscription = stock.attach(channel, Dispatch::Queued, Backpressure::Block, 4);
+        std::thread releaser([&channel] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            channel->released.store(true);
+        });
+        for(int i = 0; i < 100; ++i)
+        {
+            stock.setValue(i);
+        }
+        releaser.join();
+        pool->waitIdle();
+
+        CHECK(channel->values.size() == 100);
+        CHECK(subscription->getDropped() == 0);
+        CHECK(subscription->getDelayed() > 0);
+    }
+
+    SUBCASE("DropOldest keeps the most recent values")
+    {
+        auto subscription = stock.attach(channel, Dispatch::Queued, Backpressure::DropOldest, 4);
+        for(int i = 0; i < 100; ++i)
+        {
+            stock.setValue(i);
+        }
+        channel->released.store(true);
+        pool->waitIdle();
+
+        CHECK(subscription->getDelayed() == 0);
+        CHECK(subscription->getDelivered() + subscription->getDropped() == 100);
+        REQUIRE(channel->values.size() >= 4);
+        CHECK(channel->values.back() == 99.0);
+        CHECK(channel->values[channel->values.size() - 4] == 96.0);
+    }
+
+    SUBCASE("DropNewest keeps the values queued first")
+    {
+        auto subscription = stock.attach(channel, Dispatch::Queued, Backpressure::DropNewest, 4);
+        for(int i = 0; i < 100; ++i)
+        {
+            stock.setValue(i);
+        }
+        channel->released.store(true);
+        pool->waitIdle();
+
+        CHECK(subscription->getDelivered() + subscription->getDropped() == 100);
+        CHECK(channel->values.back() < 99.0);
+    }
+}
+
+TEST_CASE("Conflated channel at its own pace gets only the latest value")
+{
+    struct SlowScreen : public NotificationChannel
+    {
+        void notify(double value) override
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            last = value;
+            ++count;
+        }
+        double last = 0.0;
+        size_t count = 0;
+    };
+
+    auto pool = std::make_shared<DispatchPool>(1);
+    auto screen = std::make_shared<SlowScreen>();
+    Stock stock(pool);
+    auto subscription = stock.attach(screen, Dispatch::Queued, Backpressure::Conflate);
+
+    const int ticks = 100000;
+    for(int i = 1; i <= ticks; ++i)
+    {
+        stock.setValue(i);
+    }
+    pool->waitIdle();
+
+    CHECK(screen->last == double(ticks));
+    CHECK(screen->count < size_t(ticks));
+    CHECK(subscription->getDelivered() + subscription->getDropped() == size_t(ticks));
+}
+
+TEST_CASE("NaN is a value like any other for a conflated channel")
+{
+    auto pool = std::make_shared<DispatchPool>(1);
+    auto channel = std::make_shared<CountingChannel>();
+    Stock stock(pool);
+    auto subscription = stock.attach(channel, Dispatch::Queued, Backpressure::Conflate);
+
+    stock.setValue(std::numeric_limits<double>::quiet_NaN());
+    pool->waitIdle();
+    CHECK(std::isnan(channel->last));
+    CHECK(subscription->getDelivered() + subscription->getDropped() == 1);
+
+    stock.setValue(1.0);
+    stock.setValue(std::numeric_limits<double>::quiet_NaN());
+    stock.setValue(2.0);
+    pool->waitIdle();
+    CHECK(channel->last == 2.0);
+    CHECK(subscription->getDelivered() + subscription->getDropped() == 4);
+}
+
+TEST_CASE("Queued dispatch without a pool is a programming error")
+{
+    Stock stock;
+    CHECK_THROWS_AS(stock.attach(std::make_shared<LcdScreen>(), Dispatch::Queued), const std::logic_error&);
+}
+
+//Sustained throughput (until every channel got its values) and the latency of setValue() on the
+//feed thread, for every combination of observers per stock, dispatch mode and pool size.
+//Prints CSV:  ./Observer -ns -tc="Benchmark: Stock under load*" > load.csv
+TEST_CASE("Benchmark: Stock under load" * doctest::skip())
+{
+    struct LoadChannel : public NotificationChannel
+    {
+        void notify(double value) override
+        {
+            sum += value;
+        }
+        double sum = 0.0;
+    };
+
+    struct Mode
+    {
+        const char* name;
+        Dispatch dispatch;
+        Backpressure backpressure;
+    };
+
+    using LoadTesting::GeneratedTick;
+    using LoadTesting::TickGenerator;
+
+    LoadTesting::TickProfile profile;
+    profile.symbols = 64;
+    const size_t ticks = 200000;
+    std::vector<GeneratedTick> feed;
+    TickGenerator generator(2024, profile);
+    for(size_t i = 0; i < ticks; ++i)
+    {
+        feed.push_back(generator.next());
+    }
+
+    std::cout << "observers,mode,threads,ticks,ticks_per_second,p50_ns,p99_ns,p999_ns,max_ns\n";
+    for(size_t observers : {1, 8, 64})
+    {
+        for(const Mode& mode : {Mode{"inline", Dispatch::Inline, Backpressure::DropNewest},
+                                Mode{"queued", Dispatch::Queued, Backpressure::Block},
+                                Mode{"conflated", Dispatch::Queued, Backpressure::Conflate}})
+        {
+            for(size_t threads : {1, 2, 4})
+            {
+                if(mode.dispatch == Dispatch::Inline && threads > 1)
+                {
+                    continue;
+                }
+                auto pool = std::make_shared<DispatchPool>(threads);
+                std::vector<std::unique_ptr<Stock>> stocks;
+                for(size_t s = 0; s < profile.symbols; ++s)
+                {
+                    stocks.push_back(std::make_unique<Stock>(pool));
+                    for(size_t o = 0; o < observers; ++o)
+                    {
+                        stocks.back()->attach(std::make_shared<LoadChannel>(), mode.dispatch, mode.backpressure, 256);
+                    }
+                }
+
+                std::vector<std::uint64_t> latencies;
+                latencies.reserve(ticks);
+                const auto start = std::chrono::steady_clock::now();
+                for(const auto& tick : feed)
+                {
+                    const auto before = std::chrono::steady_clock::now();
+                    stocks[tick.symbol]->setValue(tick.value);
+                    latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                            std::chrono::steady_clock::now() - before).count());
+                }
+                pool->waitIdle();
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                std::sort(latencies.begin(), latencies.end());
+                auto percentile = [&latencies](double fraction) {
+                    return latencies[std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()))];
+                };
+                std::cout << observers << ',' << mode.name << ',' << (mode.dispatch == Dispatch::Inline ? 0 : threads)
+                          << ',' << ticks << ',' << static_cast<std::uint64_t>(ticks / elapsed.count())
+                          << ',' << percentile(0.5) << ',' << percentile(0.99) << ',' << percentile(0.999)
+                          << ',' << latencies.back() << '\n';
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,669 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <coroutine>
+#include <optional>
+#include <utility>
+#include <exception>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+//Observers written as coroutines
+//
+//A stateful consumer (wait for a crossing, then watch the next ten prices...) turns into a state
+//machine when written as notify() callbacks, and people end up giving each consumer a thread.
+//With coroutines the consumer is written as straight code:
+//
+//    auto value = co_await stock.next(executor);             //the next price change
+//
+//    auto prices = stock.values(executor);                   //all price changes, none missed
+//    while(auto value = co_await prices->next()) {...}
+//
+//A suspended consumer is only a coroutine frame, so thousands of them are cheap. Price changes
+//don't resume consumers directly - the consumer goes to the Executor it chose, e.g. a RunLoop
+//draining them on the dispatch thread, or InlineExecutor resuming it right inside setValue().
+
+namespace CoroutineObserver {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Updating LcdScreen\n";
+    }
+};
+
+class Executor
+{
+public:
+    virtual ~Executor() = default;
+    virtual void post(std::coroutine_handle<> consumer) = 0;
+
+    //the consumer is being destroyed after it was posted, it must not be resumed any more
+    virtual void cancel(std::coroutine_handle<> consumer) {}
+};
+
+class InlineExecutor : public Executor
+{
+public:
+    void post(std::coroutine_handle<> consumer) override
+    {
+        consumer.resume();
+    }
+};
+
+//Queue of consumers to resume, drained by whichever thread runs the loop
+class RunLoop : public Executor
+{
+public:
+    void post(std::coroutine_handle<> consumer) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(consumer);
+        }
+        wakeUp.notify_one();
+    }
+
+    //a consumer has to be destroyed on the thread running the loop, or while it isn't running
+    void cancel(std::coroutine_handle<> consumer) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.erase(std::remove(ready.begin(), ready.end(), consumer), ready.end());
+    }
+
+    //resumes everything posted so far (and whatever that posts), returns how many resumed
+    size_t runPending()
+    {
+        size_t resumed = 0;
+        for(;;)
+        {
+            //one at a time - a consumer resumed may destroy and cancel the ones after it
+            std::coroutine_handle<> consumer;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(ready.empty())
+                {
+                    return resumed;
+                }
+                consumer = ready.front();
+                ready.pop_front();
+            }
+            consumer.resume();
+            ++resumed;
+        }
+    }
+
+    //dispatch loop for a dedicated thread, returns after stop()
+    void run()
+    {
+        for(;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this] { return stopped || !ready.empty(); });
+                if(stopped && ready.empty())
+                {
+                    return;
+                }
+            }
+            runPending();
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        wakeUp.notify_one();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<std::coroutine_handle<>> ready;
+    bool stopped = false;
+};
+
+//Coroutine type for consumers: starts running right away, the frame lives as long as the Consumer
+class Consumer
+{
+public:
+    struct promise_type
+    {
+        Consumer get_return_object() { return Consumer(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Consumer(Consumer&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Consumer& operator=(Consumer&&) = delete;
+    ~Consumer()
+    {
+        if(handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    bool done() const { return handle.done(); }
+
+private:
+    explicit Consumer(std::coroutine_handle<promise_type> coroutine) : handle(coroutine) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+//Buffered stream of price changes for one consumer - it gets all of them, however slow it is
+class ValueStream : public NotificationChannel
+{
+public:
+    explicit ValueStream(Executor& consumerExecutor) : executor(consumerExecutor) {}
+
+    void notify(double value) override
+    {
+        std::coroutine_handle<> consumer;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(value);
+            consumer = std::exchange(waiting, {});
+        }
+        if(consumer)
+        {
+            executor.post(consumer);
+        }
+    }
+
+    //no more values, a waiting consumer gets std::nullopt
+    void close()
+    {
+        std::coroutine_handle<> consumer;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            consumer = std::exchange(waiting, {});
+        }
+        if(consumer)
+        {
+            executor.post(consumer);
+        }
+    }
+
+    struct NextValue
+    {
+        ValueStream& stream;
+        std::coroutine_handle<> consumer;
+        bool resumed = false;
+
+        explicit NextValue(ValueStream& valueStream) : stream(valueStream) {}
+        NextValue(const NextValue&) = delete;
+        NextValue& operator=(const NextValue&) = delete;
+
+        //a consumer destroyed while suspended must not be resumed by the next value
+        ~NextValue()
+        {
+            if(!consumer || resumed)
+            {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(stream.mutex);
+                if(stream.waiting == consumer)
+                {
+                    stream.waiting = {};
+                    return;
+                }
+            }
+            stream.executor.cancel(consumer);
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> awaiting)
+        {
+            std::lock_guard<std::mutex> lock(stream.mutex);
+            if(!stream.pending.empty() || stream.closed)
+            {
+                return false;
+            }
+            consumer = awaiting;
+            stream.waiting = awaiting;
+            return true;
+        }
+
+        std::optional<double> await_resume()
+        {
+            resumed = true;
+            std::lock_guard<std::mutex> lock(stream.mutex);
+            if(stream.pending.empty())
+            {
+                return std::nullopt;
+            }
+            const double value = stream.pending.front();
+            stream.pending.pop_front();
+            return value;
+        }
+    };
+
+    //the oldest value not consumed yet, std::nullopt once the stream is closed and drained
+    NextValue next()
+    {
+        return NextValue(*this);
+    }
+
+private:
+    Executor& executor;
+    std::mutex mutex;
+    std::deque<double> pending;
+    std::coroutine_handle<> waiting;
+    bool closed = false;
+};
+
+class Stock
+{
+public:
+    struct NextValue
+    {
+        Stock& stock;
+        Executor& executor;
+        std::coroutine_handle<> consumer;
+        std::optional<double> value;
+        std::atomic<bool> registered{false};    //in stock.waiting, changed under stock.mutex
+        bool resumed = false;
+
+        NextValue(Stock& awaitedStock, Executor& consumerExecutor) : stock(awaitedStock), executor(consumerExecutor) {}
+        NextValue(const NextValue&) = delete;
+        NextValue& operator=(const NextValue&) = delete;
+
+        //a consumer destroyed while suspended takes itself off the waiting list, or out of the
+        //executor if it has been posted already; the stock may be gone by then, unless registered
+        ~NextValue()
+        {
+            if(!consumer || resumed)
+            {
+                return;
+            }
+            if(registered)
+            {
+                std::lock_guard<std::mutex> lock(stock.mutex);
+                if(registered)
+                {
+                    stock.waiting.erase(std::find(stock.waiting.begin(), stock.waiting.end(), this));
+                    return;
+                }
+            }
+            executor.cancel(consumer);
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> awaiting)
+        {
+            std::lock_guard<std::mutex> lock(stock.mutex);
+            if(stock.closed)
+            {
+                return false;
+            }
+            consumer = awaiting;
+            stock.waiting.push_back(this);
+            registered = true;
+            return true;
+        }
+
+        std::optional<double> await_resume()
+        {
+            resumed = true;
+            return value;
+        }
+    };
+
+    ~Stock()
+    {
+        close();
+    }
+
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer->notify(value);
+        }
+        forEachStream([this](ValueStream& stream) { stream.notify(value); });
+
+        std::vector<NextValue*> resumed = takeWaiting();
+        for(auto* awaiter : resumed)
+        {
+            awaiter->value = value;
+            awaiter->executor.post(awaiter->consumer);
+        }
+    }
+
+    void attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        observers.push_back(newObserver);
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+        if(auto stream = std::dynamic_pointer_cast<ValueStream>(observer))
+        {
+            streams.erase(std::remove_if(streams.begin(), streams.end(),
+                                         [&stream](const auto& s) { return s.lock() == stream; }),
+                          streams.end());
+            stream->close();
+        }
+    }
+
+    void setValue(double newValue)
+    {
+        //just for test purposes
+        value = newValue;
+        valueChanged();
+    }
+
+    //awaitable for the next price change only; consumers awaiting it when the stock closes get std::nullopt
+    NextValue next(Executor& executor)
+    {
+        return NextValue(*this, executor);
+    }
+
+    //every price change from now on, in a stream of its own; the stock only refers to the stream,
+    //it goes away with its last consumer
+    std::shared_ptr<ValueStream> values(Executor& executor)
+    {
+        auto stream = std::make_shared<ValueStream>(executor);
+        streams.push_back(stream);
+        return stream;
+    }
+
+    //wakes up all consumers with std::nullopt
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        std::vector<NextValue*> resumed = takeWaiting();
+        for(auto* awaiter : resumed)
+        {
+            awaiter->executor.post(awaiter->consumer);
+        }
+        for(auto& observer : observers)
+        {
+            if(auto stream = std::dynamic_pointer_cast<ValueStream>(observer))
+            {
+                stream->close();
+            }
+        }
+        forEachStream([](ValueStream& stream) { stream.close(); });
+    }
+
+    size_t streamCount() const { return streams.size(); }
+
+private:
+    //prunes the streams nobody consumes any more
+    template<typename Action>
+    void forEachStream(Action&& action)
+    {
+        streams.erase(std::remove_if(streams.begin(), streams.end(), [&action](const auto& weakStream)
+                      {
+                          auto stream = weakStream.lock();
+                          if(stream)
+                          {
+                              action(*stream);
+                          }
+                          return !stream;
+                      }),
+                      streams.end());
+    }
+
+    std::vector<NextValue*> takeWaiting()
+    {
+        std::vector<NextValue*> resumed;
+        std::lock_guard<std::mutex> lock(mutex);
+        resumed.swap(waiting);
+        for(auto* awaiter : resumed)
+        {
+            awaiter->registered = false;
+        }
+        return resumed;
+    }
+
+    double value;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+    std::vector<std::weak_ptr<ValueStream>> streams;
+    std::mutex mutex;
+    std::vector<NextValue*> waiting;
+    bool closed = false;
+};
+
+Consumer printNextTwo(Stock& stock, Executor& executor)
+{
+    for(int i = 0; i < 2; ++i)
+    {
+        if(auto value = co_await stock.next(executor))
+        {
+            std::cout << "Consumer got " << *value << "\n";
+        }
+    }
+}
+
+TEST_CASE("Consumer written as a coroutine")
+{
+    InlineExecutor inlineExecutor;
+    Stock motoStock;
+    motoStock.attach(std::make_shared<LcdScreen>());
+    auto consumer = printNextTwo(motoStock, inlineExecutor);
+
+    motoStock.setValue(1.0);
+    motoStock.setValue(5.1);
+    CHECK(consumer.done());
+}
+
+TEST_CASE("Thousands of consumers are resumed by the dispatch loop")
+{
+    RunLoop loop;
+    Stock stock;
+    std::vector<double> sums(10000);
+    std::vector<Consumer> consumers;
+    for(auto& sum : sums)
+    {
+        consumers.push_back([](Stock& stock, Executor& executor, double& sum) -> Consumer
+        {
+            while(auto value = co_await stock.next(executor))
+            {
+                sum += *value;
+            }
+        }(stock, loop, sum));
+    }
+
+    for(int i = 1; i <= 10; ++i)
+    {
+        stock.setValue(i);
+        //nobody runs before the loop does
+        CHECK(sums.front() == (i - 1) * i / 2);
+        CHECK(loop.runPending() == consumers.size());
+    }
+    stock.close();
+    loop.runPending();
+
+    CHECK(std::all_of(sums.begin(), sums.end(), [](double sum) { return sum == 55.0; }));
+    CHECK(std::all_of(consumers.begin(), consumers.end(), [](const Consumer& c) { return c.done(); }));
+}
+
+TEST_CASE("Stateful consumer reads a stream without missing values")
+{
+    RunLoop loop;
+    Stock stock;
+    std::vector<double> afterCrossing;
+
+    //waits for the price to cross 100, then collects the next three prices
+    auto consumer = [](std::shared_ptr<ValueStream> prices, std::vector<double>& collected) -> Consumer
+    {
+        double previous = 0.0;
+        while(auto value = co_await prices->next())
+        {
+            const bool crossed = previous < 100.0 && *value >= 100.0;
+            previous = *value;
+            if(crossed)
+            {
+                break;
+            }
+        }
+        while(collected.size() < 3)
+        {
+            auto value = co_await prices->next();
+            if(!value)
+            {
+                break;
+            }
+            collected.push_back(*value);
+        }
+    }(stock.values(loop), afterCrossing);
+
+    //the consumer is slower than the ticks, the stream keeps them
+    for(double value : {98.0, 99.5, 100.5, 101.0, 99.0, 102.0, 103.0})
+    {
+        stock.setValue(value);
+    }
+    loop.runPending();
+
+    CHECK(consumer.done());
+    CHECK(afterCrossing == std::vector<double>{101.0, 99.0, 102.0});
+}
+
+TEST_CASE("Consumer destroyed while suspended isn't resumed")
+{
+    InlineExecutor inlineExecutor;
+    Stock stock;
+    double sum = 0.0;
+    auto summing = [](Stock& stock, Executor& executor, double& sum) -> Consumer
+    {
+        while(auto value = co_await stock.next(executor))
+        {
+            sum += *value;
+        }
+    };
+    auto survivor = summing(stock, inlineExecutor, sum);
+    {
+        auto abandoned = summing(stock, inlineExecutor, sum);
+        auto abandonedStream = [](std::shared_ptr<ValueStream> prices, double& sum) -> Consumer
+        {
+            while(auto value = co_await prices->next())
+            {
+                sum += *value;
+            }
+        }(stock.values(inlineExecutor), sum);
+        stock.setValue(1.0);
+        CHECK(sum == 3.0);
+    }
+
+    stock.setValue(2.0);
+    stock.close();
+    CHECK(sum == 5.0);
+    CHECK(survivor.done());
+}
+
+TEST_CASE("Consumer destroyed after it was posted isn't resumed, its stream goes away")
+{
+    RunLoop loop;
+    Stock stock;
+    double sum = 0.0;
+    {
+        auto waiting = [](Stock& stock, Executor& executor, double& sum) -> Consumer
+        {
+            while(auto value = co_await stock.next(executor))
+            {
+                sum += *value;
+            }
+        }(stock, loop, sum);
+        auto streaming = [](std::shared_ptr<ValueStream> prices, double& sum) -> Consumer
+        {
+            while(auto value = co_await prices->next())
+            {
+                sum += *value;
+            }
+        }(stock.values(loop), sum);
+        CHECK(stock.streamCount() == 1);
+
+        //both are in the loop's queue when they are destroyed
+        stock.setValue(1.0);
+    }
+    CHECK(loop.runPending() == 0);
+
+    //nobody consumes the stream any more, the stock lets it go instead of buffering for it
+    stock.setValue(2.0);
+    CHECK(stock.streamCount() == 0);
+    CHECK(sum == 0.0);
+}
+
+TEST_CASE("Suspended consumer may outlive the stock")
+{
+    RunLoop loop;
+    auto stock = std::make_unique<Stock>();
+    auto consumer = [](Stock& stock, Executor& executor) -> Consumer
+    {
+        co_await stock.next(executor);
+        co_await std::suspend_always{};
+    }(*stock, loop);
+
+    //closing posts the consumer, which is then destroyed before the loop runs
+    stock.reset();
+    {
+        auto destroyed = std::move(consumer);
+    }
+    CHECK(loop.runPending() == 0);
+}
+
+TEST_CASE("Consumers run on the dispatch thread while ticks come from another one")
+{
+    RunLoop loop;
+    std::thread dispatcher([&loop] { loop.run(); });
+
+    Stock stock;
+    const int ticks = 100000;
+    std::vector<double> sums(16);
+    std::vector<Consumer> consumers;
+    for(auto& sum : sums)
+    {
+        consumers.push_back([](std::shared_ptr<ValueStream> prices, double& sum) -> Consumer
+        {
+            while(auto value = co_await prices->next())
+            {
+                sum += *value;
+            }
+        }(stock.values(loop), sum));
+    }
+
+    for(int i = 1; i <= ticks; ++i)
+    {
+        stock.setValue(i);
+    }
+    stock.close();
+    loop.stop();
+    dispatcher.join();
+
+    const double expected = static_cast<double>(ticks) * (ticks + 1) / 2;
+    CHECK(std::all_of(sums.begin(), sums.end(), [expected](double sum) { return sum == expected; }));
+    CHECK(std::all_of(consumers.begin(), consumers.end(), [](const Consumer& c) { return c.done(); }));
+}
+
+}
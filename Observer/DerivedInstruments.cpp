@@ -0,0 +1,357 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <string>
+
+//Derived instruments built from observers
+//
+//An Index is a weighted sum of other instruments - Stocks or other Indexes - and observes them
+//like any other NotificationChannel would. The instruments form a DAG.
+//
+//Recomputing the whole index on every constituent tick costs O(index size). Instead every
+//constituent link remembers the last value it has seen and applies only the difference:
+//index += weight * (new - old), so a tick costs O(fan-out).
+//
+//Observers of an Index are not notified on every constituent tick. Changed indexes are marked
+//dirty in the PricingGraph and published once per tick cycle, by PricingGraph::commit(), in
+//topological order - every Index is published after all of its constituents, exactly once.
+
+namespace DerivedInstruments {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Updating LcdScreen with " << value << "\n";
+    }
+};
+
+class Instrument
+{
+protected:
+    double value = 0.0;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+    //0 for Stocks, 1 + highest rank of the constituents for Indexes
+    size_t rank = 0;
+public:
+    virtual ~Instrument() = default;
+
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer->notify(value);
+        }
+    }
+
+    void attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        observers.push_back(newObserver);
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+    }
+
+    double getValue() const { return value; }
+    size_t getRank() const { return rank; }
+};
+
+class Stock : public Instrument
+{
+public:
+    explicit Stock(double initialValue = 0.0)
+    {
+        value = initialValue;
+    }
+
+    void setValue(double newValue)
+    {
+        value = newValue;
+        valueChanged();
+    }
+};
+
+class Index;
+
+//Collects indexes changed during a tick cycle and publishes them in topological order
+class PricingGraph
+{
+public:
+    void markDirty(Index& index);
+    void forget(Index& index);
+
+    //ends the tick cycle
+    void commit();
+
+private:
+    std::vector<std::vector<Index*>> dirtyByRank;
+};
+
+class Index : public Instrument
+{
+public:
+    Index(PricingGraph& pricingGraph, const std::vector<std::pair<Instrument*, double>>& weightedConstituents)
+        : graph(pricingGraph)
+    {
+        for(const auto& [instrument, weight] : weightedConstituents)
+        {
+            const auto slot = constituents.size();
+            constituents.push_back({instrument, std::make_shared<ConstituentLink>(*this, slot),
+                                    instrument->getValue(), weight});
+            instrument->attach(constituents.back().link);
+            rank = std::max(rank, instrument->getRank() + 1);
+        }
+        recompute();
+    }
+
+    //constituents must outlive the Index
+    ~Index()
+    {
+        for(auto& constituent : constituents)
+        {
+            constituent.instrument->detach(constituent.link);
+        }
+        graph.forget(*this);
+    }
+
+    //constituent links point back to this Index, it can't be copied
+    Index(const Index&) = delete;
+    Index& operator=(const Index&) = delete;
+
+    //full O(n) recomputation, also done periodically to get rid of accumulated rounding errors
+    void recompute()
+    {
+        double sum = 0.0;
+        for(const auto& constituent : constituents)
+        {
+            sum += constituent.weight * constituent.lastValue;
+        }
+        value = sum;
+        deltasSinceRecompute = 0;
+    }
+
+    bool isDirty() const { return dirty; }
+
+private:
+    friend class PricingGraph;
+
+    class ConstituentLink;
+
+    struct Constituent
+    {
+        Instrument* instrument;
+        std::shared_ptr<NotificationChannel> link;
+        double lastValue;
+        double weight;
+    };
+
+    class ConstituentLink : public NotificationChannel
+    {
+    public:
+        ConstituentLink(Index& theIndex, size_t theSlot) : index(theIndex), slot(theSlot) {}
+        void notify(double value) override
+        {
+            index.constituentChanged(slot, value);
+        }
+    private:
+        Index& index;
+        const size_t slot;
+    };
+
+    void constituentChanged(size_t slot, double newValue)
+    {
+        auto& constituent = constituents[slot];
+        value += constituent.weight * (newValue - constituent.lastValue);
+        constituent.lastValue = newValue;
+        if(++deltasSinceRecompute == recomputeInterval)
+        {
+            recompute();
+        }
+        graph.markDirty(*this);
+    }
+
+    void publish()
+    {
+        dirty = false;
+        valueChanged();
+    }
+
+    static constexpr size_t recomputeInterval = 1 << 16;
+
+    PricingGraph& graph;
+    std::vector<Constituent> constituents;
+    size_t deltasSinceRecompute = 0;
+    bool dirty = false;
+};
+
+void PricingGraph::markDirty(Index& index)
+{
+    if(index.dirty)
+    {
+        return;
+    }
+    index.dirty = true;
+    if(dirtyByRank.size() <= index.getRank())
+    {
+        dirtyByRank.resize(index.getRank() + 1);
+    }
+    dirtyByRank[index.getRank()].push_back(&index);
+}
+
+void PricingGraph::forget(Index& index)
+{
+    if(index.dirty)
+    {
+        auto& bucket = dirtyByRank[index.getRank()];
+        bucket.erase(std::remove(bucket.begin(), bucket.end(), &index), bucket.end());
+    }
+}
+
+void PricingGraph::commit()
+{
+    //publishing an Index may dirty Indexes of higher rank only, which are handled later in this loop;
+    //that can grow dirtyByRank, so no reference into it is kept across publish()
+    for(size_t rank = 0; rank < dirtyByRank.size(); ++rank)
+    {
+        for(size_t i = 0; i < dirtyByRank[rank].size(); ++i)
+        {
+            dirtyByRank[rank][i]->publish();
+        }
+        dirtyByRank[rank].clear();
+    }
+}
+
+class RecordingChannel : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        values.push_back(value);
+    }
+    std::vector<double> values;
+};
+
+TEST_CASE("Index of stocks is updated incrementally and published once per tick cycle")
+{
+    PricingGraph graph;
+    Stock moto(10.0), nokia(20.0), ericsson(30.0);
+    Index telecom(graph, {{&moto, 0.5}, {&nokia, 0.25}, {&ericsson, 0.25}});
+
+    auto lcd = std::make_shared<LcdScreen>();
+    auto recorder = std::make_shared<RecordingChannel>();
+    telecom.attach(lcd);
+    telecom.attach(recorder);
+
+    CHECK(telecom.getValue() == doctest::Approx(17.5));
+
+    moto.setValue(12.0);
+    nokia.setValue(24.0);
+    CHECK(telecom.isDirty());
+    CHECK(recorder->values.empty());
+
+    graph.commit();
+    CHECK_FALSE(telecom.isDirty());
+    CHECK(recorder->values == std::vector<double>{19.5});
+
+    graph.commit();
+    CHECK(recorder->values.size() == 1);
+}
+
+TEST_CASE("Indexes of indexes are published in topological order")
+{
+    PricingGraph graph;
+    Stock a(1.0), b(2.0), c(3.0);
+    Index left(graph, {{&a, 1.0}, {&b, 1.0}});
+    Index right(graph, {{&b, 1.0}, {&c, 1.0}});
+    //diamond: b reaches top through both left and right, a directly as well
+    Index top(graph, {{&left, 1.0}, {&right, 2.0}, {&a, 10.0}});
+
+    CHECK(top.getRank() == 2);
+    CHECK(top.getValue() == doctest::Approx(3.0 + 2 * 5.0 + 10.0));
+
+    std::vector<std::string> order;
+    struct OrderChannel : public NotificationChannel
+    {
+        OrderChannel(std::vector<std::string>& theOrder, std::string theName) : order(theOrder), name(theName) {}
+        void notify(double value) override { order.push_back(name); }
+        std::vector<std::string>& order;
+        std::string name;
+    };
+    top.attach(std::make_shared<OrderChannel>(order, "top"));
+    left.attach(std::make_shared<OrderChannel>(order, "left"));
+    right.attach(std::make_shared<OrderChannel>(order, "right"));
+
+    a.setValue(2.0);
+    b.setValue(4.0);
+    graph.commit();
+
+    CHECK(order == std::vector<std::string>{"left", "right", "top"});
+    CHECK(left.getValue() == doctest::Approx(6.0));
+    CHECK(right.getValue() == doctest::Approx(7.0));
+    CHECK(top.getValue() == doctest::Approx(6.0 + 2 * 7.0 + 20.0));
+}
+
+TEST_CASE("Index of an index is published in the same tick cycle")
+{
+    PricingGraph graph;
+    Stock a(1.0);
+    Index left(graph, {{&a, 1.0}});
+    Index top(graph, {{&left, 3.0}});
+    auto recorder = std::make_shared<RecordingChannel>();
+    top.attach(recorder);
+
+    //top is the first Index of rank 2 to become dirty, while rank 1 is being published
+    a.setValue(2.0);
+    graph.commit();
+
+    CHECK(recorder->values == std::vector<double>{6.0});
+    CHECK_FALSE(top.isDirty());
+}
+
+TEST_CASE("Large index stays exact with delta updates")
+{
+    PricingGraph graph;
+    const size_t size = 2000;
+    std::vector<std::unique_ptr<Stock>> stocks;
+    std::vector<std::pair<Instrument*, double>> weights;
+    for(size_t i = 0; i < size; ++i)
+    {
+        stocks.push_back(std::make_unique<Stock>(100.0 + i));
+        weights.push_back({stocks.back().get(), 1.0 / (i + 1)});
+    }
+    Index index(graph, weights);
+
+    for(size_t tick = 0; tick < 100000; ++tick)
+    {
+        const auto i = (tick * 7919) % size;
+        stocks[i]->setValue(100.0 + std::sin(double(tick)) * 10.0);
+        if(tick % 100 == 0)
+        {
+            graph.commit();
+        }
+    }
+    graph.commit();
+
+    double expected = 0.0;
+    for(size_t i = 0; i < size; ++i)
+    {
+        expected += stocks[i]->getValue() / (i + 1);
+    }
+    CHECK(index.getValue() == doctest::Approx(expected).epsilon(1e-9));
+}
+
+}
@@ -0,0 +1,392 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <sched.h>
+
+//Sharded event bus
+//
+//TickRing.cpp feeds one dispatch thread; the bus spreads the fan-out itself over several.
+//
+//Symbols are partitioned across N shards, each with its own dispatch thread pinned to a core.
+//A shard owns the observer lists of its symbols and is the only thread touching them.
+//
+//Every channel is subscribed with a home shard - the thread its notify() runs on. When the home
+//shard doesn't own the symbol, the owner forwards the tick through an SPSC ring dedicated to
+//that pair of shards. Shards share no data structure but those rings, so there are no locks and
+//throughput scales with the number of cores.
+//
+//Subscriptions are set up before start(). The feed is a single thread calling publish(). A bus
+//runs once: after stop() it can't be started again.
+
+namespace ShardedObserver {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+struct Tick
+{
+    std::uint32_t symbol;
+    double value;
+};
+
+constexpr size_t cacheLine = 64;
+
+//Single producer / single consumer ring, the same as in TickRing.cpp.
+//Producer and consumer indexes live on separate cache lines. Each side also keeps a private
+//copy of the other side's index and re-reads the shared one only when the copy says the ring
+//is full (or empty), so in the common case no cache line bounces between the cores.
+template<typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+    bool tryPush(const T& item)
+    {
+        const auto t = producer.tail.load(std::memory_order_relaxed);
+        if(t - producer.cachedHead == Capacity)
+        {
+            producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+            if(t - producer.cachedHead == Capacity)
+            {
+                return false;
+            }
+        }
+        slots[t & (Capacity - 1)] = item;
+        producer.tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    //takes up to maxCount items, publishes the new head once for the whole batch
+    size_t popBatch(T* out, size_t maxCount)
+    {
+        const auto h = consumer.head.load(std::memory_order_relaxed);
+        if(consumer.cachedTail == h)
+        {
+            consumer.cachedTail = producer.tail.load(std::memory_order_acquire);
+        }
+        const auto count = std::min<size_t>(consumer.cachedTail - h, maxCount);
+        for(size_t i = 0; i < count; ++i)
+        {
+            out[i] = slots[(h + i) & (Capacity - 1)];
+        }
+        if(count)
+        {
+            consumer.head.store(h + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+private:
+    struct alignas(cacheLine) ProducerSide
+    {
+        std::atomic<size_t> tail{0};
+        size_t cachedHead = 0;
+    };
+    struct alignas(cacheLine) ConsumerSide
+    {
+        std::atomic<size_t> head{0};
+        size_t cachedTail = 0;
+    };
+
+    ProducerSide producer;
+    ConsumerSide consumer;
+    alignas(cacheLine) std::array<T, Capacity> slots;
+};
+
+class EventBus
+{
+public:
+    explicit EventBus(size_t shardCount, bool pinThreads = true) : pin(pinThreads)
+    {
+        if(shardCount == 0)
+        {
+            throw std::invalid_argument("EventBus needs at least one shard");
+        }
+        for(size_t i = 0; i < shardCount; ++i)
+        {
+            shards.push_back(std::make_unique<Shard>(i, shardCount));
+        }
+    }
+
+    ~EventBus()
+    {
+        stop();
+    }
+
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    size_t ownerOf(std::uint32_t symbol) const { return symbol % shards.size(); }
+    size_t shardCount() const { return shards.size(); }
+
+    void subscribe(std::uint32_t symbol, std::shared_ptr<NotificationChannel> channel, size_t homeShard)
+    {
+        if(running)
+        {
+            throw std::logic_error("EventBus subscriptions must be set up before start()");
+        }
+        auto& owner = *shards[ownerOf(symbol)];
+        auto& home = *shards.at(homeShard);
+        if(&owner == &home)
+        {
+            owner.local[symbol].push_back(std::move(channel));
+            return;
+        }
+        auto& forwards = owner.forwardTo[symbol];
+        if(std::find(forwards.begin(), forwards.end(), homeShard) == forwards.end())
+        {
+            forwards.push_back(homeShard);
+        }
+        home.remote[symbol].push_back(std::move(channel));
+    }
+
+    void start()
+    {
+        if(started)
+        {
+            throw std::logic_error("EventBus can be started only once");
+        }
+        started = true;
+        running = true;
+        for(auto& shard : shards)
+        {
+            shard->thread = std::thread([this, &shard] { run(*shard); });
+            if(pin)
+            {
+                pinToCore(shard->thread, shard->index);
+            }
+        }
+    }
+
+    //feed thread only
+    void publish(std::uint32_t symbol, double value)
+    {
+        auto& ring = shards[ownerOf(symbol)]->feed;
+        while(!ring.tryPush(Tick{symbol, value}))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    //delivers everything published so far and joins the dispatch threads
+    void stop()
+    {
+        if(!running)
+        {
+            return;
+        }
+        stopping.store(true);
+        for(auto& shard : shards)
+        {
+            shard->thread.join();
+        }
+        running = false;
+    }
+
+private:
+    using Ring = SpscRing<Tick, 4096>;
+
+    struct Shard
+    {
+        Shard(size_t theIndex, size_t shardCount) : index(theIndex)
+        {
+            for(size_t i = 0; i < shardCount; ++i)
+            {
+                incoming.push_back(std::make_unique<Ring>());
+            }
+        }
+
+        const size_t index;
+        std::thread thread;
+        Ring feed;
+        //incoming[i] carries ticks forwarded by shard i
+        std::vector<std::unique_ptr<Ring>> incoming;
+        //channels homed here, for symbols owned here
+        std::unordered_map<std::uint32_t, std::vector<std::shared_ptr<NotificationChannel>>> local;
+        //channels homed here, for symbols owned by other shards
+        std::unordered_map<std::uint32_t, std::vector<std::shared_ptr<NotificationChannel>>> remote;
+        //shards to forward each owned symbol to
+        std::unordered_map<std::uint32_t, std::vector<size_t>> forwardTo;
+        std::atomic<bool> feedDrained{false};
+    };
+
+    static void notifyAll(const std::unordered_map<std::uint32_t, std::vector<std::shared_ptr<NotificationChannel>>>& observers,
+                          const Tick& tick)
+    {
+        auto found = observers.find(tick.symbol);
+        if(found != observers.end())
+        {
+            for(auto& channel : found->second)
+            {
+                channel->notify(tick.value);
+            }
+        }
+    }
+
+    size_t drainIncoming(Shard& shard)
+    {
+        std::array<Tick, 64> batch;
+        size_t total = 0;
+        for(auto& ring : shard.incoming)
+        {
+            const auto count = ring->popBatch(batch.data(), batch.size());
+            for(size_t i = 0; i < count; ++i)
+            {
+                notifyAll(shard.remote, batch[i]);
+            }
+            total += count;
+        }
+        return total;
+    }
+
+    size_t drainFeed(Shard& shard)
+    {
+        std::array<Tick, 64> batch;
+        const auto count = shard.feed.popBatch(batch.data(), batch.size());
+        for(size_t i = 0; i < count; ++i)
+        {
+            const auto& tick = batch[i];
+            notifyAll(shard.local, tick);
+            auto forwards = shard.forwardTo.find(tick.symbol);
+            if(forwards == shard.forwardTo.end())
+            {
+                continue;
+            }
+            for(auto target : forwards->second)
+            {
+                auto& ring = *shards[target]->incoming[shard.index];
+                while(!ring.tryPush(tick))
+                {
+                    //the target may be waiting for us as well - keep our own inbox moving
+                    drainIncoming(shard);
+                }
+            }
+        }
+        return count;
+    }
+
+    bool allFeedsDrained() const
+    {
+        return std::all_of(shards.begin(), shards.end(),
+                           [](const std::unique_ptr<Shard>& s) { return s->feedDrained.load(); });
+    }
+
+    void run(Shard& shard)
+    {
+        for(;;)
+        {
+            const auto done = drainFeed(shard) + drainIncoming(shard);
+            if(done)
+            {
+                continue;
+            }
+            if(stopping.load())
+            {
+                //the feed is stopped once publish() returned, so an empty feed ring stays empty
+                shard.feedDrained.store(true);
+                if(allFeedsDrained() && drainIncoming(shard) == 0)
+                {
+                    return;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    static void pinToCore(std::thread& thread, size_t index)
+    {
+        const auto cores = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cores, &set);
+        //pinning is an optimization only, the bus works without it
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    }
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    const bool pin;
+    bool started = false;
+    bool running = false;
+    std::atomic<bool> stopping{false};
+};
+
+TEST_CASE("Sharded event bus delivers on the home shard of each channel")
+{
+    struct ThreadCheckingChannel : public NotificationChannel
+    {
+        void notify(double value) override
+        {
+            if(count++ == 0)
+            {
+                thread = std::this_thread::get_id();
+            }
+            sameThread = sameThread && thread == std::this_thread::get_id();
+            inOrder = inOrder && value > last;
+            last = value;
+        }
+        std::thread::id thread;
+        bool sameThread = true;
+        bool inOrder = true;
+        double last = 0.0;
+        size_t count = 0;
+    };
+
+    const std::uint32_t symbols = 64;
+    const size_t ticksPerSymbol = 2000;
+    EventBus bus(4, false);
+
+    std::vector<std::shared_ptr<ThreadCheckingChannel>> channels;
+    for(std::uint32_t symbol = 0; symbol < symbols; ++symbol)
+    {
+        //one channel on the owning shard, one on every other shard
+        for(size_t home = 0; home < bus.shardCount(); ++home)
+        {
+            channels.push_back(std::make_shared<ThreadCheckingChannel>());
+            bus.subscribe(symbol, channels.back(), home);
+        }
+    }
+    //a channel watching several symbols owned by different shards
+    auto watchlist = std::make_shared<ThreadCheckingChannel>();
+    for(std::uint32_t symbol : {1u, 2u, 3u})
+    {
+        bus.subscribe(symbol, watchlist, 0);
+    }
+
+    bus.start();
+    CHECK_THROWS_AS(bus.subscribe(0, watchlist, 0), const std::logic_error&);
+    for(size_t i = 1; i <= ticksPerSymbol; ++i)
+    {
+        for(std::uint32_t symbol = 0; symbol < symbols; ++symbol)
+        {
+            bus.publish(symbol, double(i));
+        }
+    }
+    bus.stop();
+    CHECK_THROWS_AS(bus.start(), const std::logic_error&);
+
+    for(auto& channel : channels)
+    {
+        CHECK(channel->count == ticksPerSymbol);
+        CHECK(channel->inOrder);
+        CHECK(channel->sameThread);
+    }
+    CHECK(watchlist->count == 3 * ticksPerSymbol);
+    CHECK(watchlist->sameThread);
+}
+
+}
@@ -0,0 +1,260 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+//Observer with filtered subscriptions
+//
+//In the raw design Buzzer checks its own "enabled" flag inside notify(), so every channel is
+//called on every tick, even when it doesn't care. Here the interest of a channel is described
+//by a Filter given to Stock::attach() and the Stock calls only the channels that are interested.
+//
+//Every filter is turned into a band [lower, upper] - the channel is notified when the value
+//leaves the band. The bands of all subscriptions are kept in two contiguous arrays, so a tick
+//is checked against all of them in one branch-free loop which the compiler vectorizes.
+//
+//above(x)         - notified on every tick above x
+//below(x)         - notified on every tick below x
+//crossing(level)  - notified when the value crosses the level (in either direction)
+//percentChange(p) - notified when the value moved by more than p percent since the last notification
+
+namespace FilteredObserver {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Updating LcdScreen\n";
+    }
+};
+
+class Buzzer : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Triggering Buzzer\n";
+    }
+};
+
+class SmsNotification : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Sending SmsNotification\n";
+    }
+};
+
+class Filter
+{
+public:
+    enum class Kind
+    {
+        Always,
+        Above,
+        Below,
+        Crossing,
+        PercentChange
+    };
+
+    static Filter always() { return Filter(Kind::Always, 0.0); }
+    static Filter above(double threshold) { return Filter(Kind::Above, threshold); }
+    static Filter below(double threshold) { return Filter(Kind::Below, threshold); }
+    static Filter crossing(double level) { return Filter(Kind::Crossing, level); }
+    static Filter percentChange(double percent) { return Filter(Kind::PercentChange, percent / 100.0); }
+
+    Kind getKind() const { return kind; }
+
+    //the channel is notified when the value is below lower or above upper,
+    //reference is the last value the channel has been notified with
+    void band(double reference, double& lower, double& upper) const
+    {
+        constexpr auto inf = std::numeric_limits<double>::infinity();
+        switch(kind)
+        {
+        case Kind::Always:
+            lower = inf;
+            upper = -inf;
+            break;
+        case Kind::Above:
+            lower = -inf;
+            upper = parameter;
+            break;
+        case Kind::Below:
+            lower = parameter;
+            upper = inf;
+            break;
+        case Kind::Crossing:
+            lower = reference >= parameter ? parameter : -inf;
+            upper = reference >= parameter ? inf : parameter;
+            break;
+        case Kind::PercentChange:
+            lower = reference - std::abs(reference) * parameter;
+            upper = reference + std::abs(reference) * parameter;
+            break;
+        }
+    }
+
+    //whether the band has to be recalculated after the channel has been notified
+    bool isStateful() const { return kind == Kind::Crossing || kind == Kind::PercentChange; }
+
+private:
+    Filter(Kind theKind, double theParameter) : kind(theKind), parameter(theParameter) {}
+
+    Kind kind;
+    double parameter;
+};
+
+class Stock
+{
+private:
+    double value;
+
+    //subscriptions in struct-of-arrays form, index i describes one subscription
+    std::vector<double> lower;
+    std::vector<double> upper;
+    std::vector<Filter> filters;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+    std::vector<std::uint8_t> interested;
+
+    void collectInterested()
+    {
+        const auto count = observers.size();
+        const double* lo = lower.data();
+        const double* hi = upper.data();
+        std::uint8_t* mask = interested.data();
+        const double current = value;
+        for(size_t i = 0; i < count; ++i)
+        {
+            mask[i] = (current < lo[i]) | (current > hi[i]);
+        }
+    }
+
+public:
+    explicit Stock(double initialValue = 0.0) : value(initialValue) {}
+
+    void valueChanged()
+    {
+        collectInterested();
+        for(size_t i = 0; i < observers.size(); ++i)
+        {
+            if(interested[i])
+            {
+                if(filters[i].isStateful())
+                {
+                    filters[i].band(value, lower[i], upper[i]);
+                }
+                observers[i]->notify(value);
+            }
+        }
+    }
+
+    void attach(std::shared_ptr<NotificationChannel> newObserver, Filter filter = Filter::always())
+    {
+        double lo = 0.0, hi = 0.0;
+        filter.band(value, lo, hi);
+        lower.push_back(lo);
+        upper.push_back(hi);
+        filters.push_back(filter);
+        observers.push_back(std::move(newObserver));
+        interested.push_back(0);
+    }
+
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        for(size_t i = observers.size(); i-- > 0;)
+        {
+            if(observers[i] == observer)
+            {
+                lower.erase(lower.begin() + i);
+                upper.erase(upper.begin() + i);
+                filters.erase(filters.begin() + i);
+                observers.erase(observers.begin() + i);
+                interested.erase(interested.begin() + i);
+            }
+        }
+    }
+
+    void setValue(double newValue)
+    {
+        //just for test purposes
+        value = newValue;
+        valueChanged();
+    }
+};
+
+TEST_CASE("Buzzer is triggered only when the price crosses the alarm level")
+{
+    auto lcd  = std::make_shared<LcdScreen>();
+    auto buzz = std::make_shared<Buzzer>();
+    auto sms  = std::make_shared<SmsNotification>();
+
+    Stock motoStock(3.0);
+
+    motoStock.attach(lcd);
+    motoStock.attach(buzz, Filter::crossing(4.0));
+    motoStock.attach(sms, Filter::percentChange(10.0));
+
+    motoStock.setValue(3.1);
+    motoStock.setValue(5.0);
+}
+
+class CountingChannel : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        values.push_back(value);
+    }
+    std::vector<double> values;
+};
+
+TEST_CASE("Only interested channels are notified")
+{
+    auto always   = std::make_shared<CountingChannel>();
+    auto above    = std::make_shared<CountingChannel>();
+    auto below    = std::make_shared<CountingChannel>();
+    auto crossing = std::make_shared<CountingChannel>();
+    auto band     = std::make_shared<CountingChannel>();
+
+    Stock stock(100.0);
+    stock.attach(always);
+    stock.attach(above, Filter::above(105.0));
+    stock.attach(below, Filter::below(95.0));
+    stock.attach(crossing, Filter::crossing(100.5));
+    stock.attach(band, Filter::percentChange(5.0));
+
+    for(double v : {101.0, 102.0, 106.0, 99.0, 94.5, 99.5, 104.0})
+    {
+        stock.setValue(v);
+    }
+
+    CHECK(always->values.size() == 7);
+    CHECK(above->values == std::vector<double>{106.0});
+    CHECK(below->values == std::vector<double>{94.5});
+    CHECK(crossing->values == std::vector<double>{101.0, 99.0, 104.0});
+    //106 is more than 5% from 100, 99 is more than 5% from 106, 94.5 is not 5% from 99,
+    //104 is more than 5% from 99
+    CHECK(band->values == std::vector<double>{106.0, 99.0, 104.0});
+
+    stock.detach(always);
+    stock.setValue(120.0);
+    CHECK(always->values.size() == 7);
+    CHECK(above->values.size() == 2);
+}
+
+}
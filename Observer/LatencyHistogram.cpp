@@ -0,0 +1,318 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+//Observer measuring its observers
+//
+//To see which NotificationChannel eats the tick-to-notify budget, Stock::valueChanged() times
+//every notify() call and records two latencies per channel:
+//- how long its notify() took
+//- how long after the tick arrived the channel got it (tick-to-delivery), which includes the
+//  time spent in all channels notified before it
+//
+//The latencies go to HDR-style histograms - log-linear buckets with a fixed relative error -
+//which are updated with relaxed atomic increments, so a monitoring thread can take a snapshot
+//with p50 / p99 / p99.9 / max at any time without stopping the ticks.
+
+namespace InstrumentedObserver {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Updating LcdScreen\n";
+    }
+};
+
+class SmsNotification : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Sending SmsNotification\n";
+    }
+};
+
+struct LatencySnapshot
+{
+    std::uint64_t count = 0;
+    std::uint64_t p50 = 0;      //nanoseconds
+    std::uint64_t p99 = 0;
+    std::uint64_t p999 = 0;
+    std::uint64_t max = 0;
+};
+
+//Values below 2^precision are counted exactly, above that every power of two is split into
+//2^precision buckets, so a reported value is at most 1/2^precision (< 1%) above the real one.
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned precision = 7;
+    static constexpr unsigned maxBits = 40;     //~18 minutes in ns, longer values are clamped
+
+    void record(std::uint64_t value)
+    {
+        value = std::min(value, highest);
+        counts[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        auto currentMax = maximum.load(std::memory_order_relaxed);
+        while(value > currentMax && !maximum.compare_exchange_weak(currentMax, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    //highest value of the bucket in which the given fraction (0..1) of the recorded values falls
+    std::uint64_t percentile(double fraction) const
+    {
+        const auto count = total.load(std::memory_order_relaxed);
+        if(!count)
+        {
+            return 0;
+        }
+        const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(fraction * count + 0.5));
+        std::uint64_t seen = 0;
+        for(size_t i = 0; i < bucketCount; ++i)
+        {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if(seen >= rank)
+            {
+                return std::min(highestInBucket(i), maximum.load(std::memory_order_relaxed));
+            }
+        }
+        return maximum.load(std::memory_order_relaxed);
+    }
+
+    LatencySnapshot snapshot() const
+    {
+        return {total.load(std::memory_order_relaxed), percentile(0.5), percentile(0.99), percentile(0.999),
+                maximum.load(std::memory_order_relaxed)};
+    }
+
+private:
+    static constexpr std::uint64_t subBuckets = std::uint64_t(1) << precision;
+    static constexpr std::uint64_t highest = (std::uint64_t(1) << maxBits) - 1;
+    static constexpr size_t bucketCount = (maxBits - precision + 1) * subBuckets;
+
+    static size_t indexOf(std::uint64_t value)
+    {
+        if(value < subBuckets)
+        {
+            return value;
+        }
+        const unsigned msb = std::bit_width(value) - 1;
+        const unsigned shift = msb - precision;
+        return (shift + 1) * subBuckets + ((value >> shift) - subBuckets);
+    }
+
+    static std::uint64_t highestInBucket(size_t index)
+    {
+        if(index < 2 * subBuckets)
+        {
+            return index;
+        }
+        const unsigned shift = index / subBuckets - 1;
+        const std::uint64_t mantissa = subBuckets + index % subBuckets;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::array<std::atomic<std::uint64_t>, bucketCount> counts{};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> maximum{0};
+};
+
+struct ChannelLatency
+{
+    std::string name;
+    LatencySnapshot notifyDuration;
+    LatencySnapshot tickToDelivery;
+};
+
+//Histograms of one subscription, may be kept and read by a monitoring thread
+class ChannelStatistics
+{
+public:
+    explicit ChannelStatistics(std::string channelName) : name(std::move(channelName)) {}
+
+    ChannelLatency snapshot() const
+    {
+        return {name, notifyDuration.snapshot(), tickToDelivery.snapshot()};
+    }
+
+    const std::string name;
+    LatencyHistogram notifyDuration;
+    LatencyHistogram tickToDelivery;
+};
+
+class Stock
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Subscription
+    {
+        std::shared_ptr<NotificationChannel> channel;
+        std::shared_ptr<ChannelStatistics> statistics;
+    };
+
+    double value;
+    Clock::time_point tickArrival;
+    std::vector<Subscription> observers;
+
+    static std::uint64_t nanoseconds(Clock::duration duration)
+    {
+        return std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+
+public:
+    void valueChanged()
+    {
+        auto before = Clock::now();
+        for(auto& observer : observers)
+        {
+            observer.channel->notify(value);
+            const auto after = Clock::now();
+            observer.statistics->notifyDuration.record(nanoseconds(after - before));
+            observer.statistics->tickToDelivery.record(nanoseconds(after - tickArrival));
+            before = after;
+        }
+    }
+
+    std::shared_ptr<ChannelStatistics> attach(std::shared_ptr<NotificationChannel> newObserver, std::string name = "")
+    {
+        auto statistics = std::make_shared<ChannelStatistics>(std::move(name));
+        observers.push_back({std::move(newObserver), statistics});
+        return statistics;
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove_if(observers.begin(), observers.end(),
+                                       [&observer](const Subscription& s) { return s.channel == observer; }),
+                        observers.end());
+    }
+
+    //arrival is when the tick entered the system, e.g. when the feed handler received it
+    void setValue(double newValue, Clock::time_point arrival)
+    {
+        value = newValue;
+        tickArrival = arrival;
+        valueChanged();
+    }
+
+    void setValue(double newValue)
+    {
+        setValue(newValue, Clock::now());
+    }
+
+    std::vector<ChannelLatency> latencies() const
+    {
+        std::vector<ChannelLatency> result;
+        for(const auto& observer : observers)
+        {
+            result.push_back(observer.statistics->snapshot());
+        }
+        return result;
+    }
+};
+
+TEST_CASE("Which channel eats the budget?")
+{
+    Stock motoStock;
+    motoStock.attach(std::make_shared<LcdScreen>(), "lcd");
+    motoStock.attach(std::make_shared<SmsNotification>(), "sms");
+
+    motoStock.setValue(1.0);
+    motoStock.setValue(5.1);
+
+    for(const auto& channel : motoStock.latencies())
+    {
+        std::cout << channel.name << ": notify p50 " << channel.notifyDuration.p50
+                  << " ns, p99 " << channel.notifyDuration.p99
+                  << " ns, max " << channel.notifyDuration.max
+                  << " ns, tick-to-delivery p99 " << channel.tickToDelivery.p99 << " ns\n";
+    }
+}
+
+TEST_CASE("Histogram percentiles are within the precision of the histogram")
+{
+    LatencyHistogram histogram;
+    for(std::uint64_t value = 1; value <= 100000; ++value)
+    {
+        histogram.record(value);
+    }
+    const auto snapshot = histogram.snapshot();
+
+    CHECK(snapshot.count == 100000);
+    CHECK(snapshot.max == 100000);
+    CHECK(snapshot.p50 >= 50000);
+    CHECK(snapshot.p50 <= 50000 * 1.01);
+    CHECK(snapshot.p99 >= 99000);
+    CHECK(snapshot.p99 <= 99000 * 1.01);
+    CHECK(snapshot.p999 >= 99900);
+    CHECK(snapshot.p999 <= 100000);
+
+    LatencyHistogram small;
+    small.record(3);
+    small.record(3);
+    small.record(100);
+    CHECK(small.percentile(0.5) == 3);
+    CHECK(small.percentile(1.0) == 100);
+}
+
+TEST_CASE("Slow channel shows up in its own histogram and delays the ones after it")
+{
+    struct BusyChannel : public NotificationChannel
+    {
+        explicit BusyChannel(std::chrono::microseconds theCost) : cost(theCost) {}
+        void notify(double value) override
+        {
+            const auto until = std::chrono::steady_clock::now() + cost;
+            while(std::chrono::steady_clock::now() < until)
+            {
+            }
+        }
+        std::chrono::microseconds cost;
+    };
+
+    Stock stock;
+    auto fast = stock.attach(std::make_shared<BusyChannel>(std::chrono::microseconds(0)), "fast");
+    auto slow = stock.attach(std::make_shared<BusyChannel>(std::chrono::microseconds(200)), "slow");
+    stock.attach(std::make_shared<BusyChannel>(std::chrono::microseconds(0)), "last");
+
+    for(int i = 0; i < 200; ++i)
+    {
+        stock.setValue(i);
+    }
+
+    const auto latencies = stock.latencies();
+    REQUIRE(latencies.size() == 3);
+    CHECK(latencies[1].name == "slow");
+    CHECK(latencies[1].notifyDuration.count == 200);
+    CHECK(latencies[1].notifyDuration.p50 >= 200000);
+    CHECK(latencies[0].notifyDuration.p50 < latencies[1].notifyDuration.p50);
+    CHECK(latencies[2].notifyDuration.p50 < latencies[1].notifyDuration.p50);
+    CHECK(latencies[2].tickToDelivery.p50 >= 200000);
+
+    //statistics handed out by attach() are the ones the stock keeps updating
+    CHECK(slow->snapshot().notifyDuration.count == 200);
+    stock.setValue(1.0);
+    CHECK(fast->snapshot().notifyDuration.count == 201);
+}
+
+}
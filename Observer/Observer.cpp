@@ -4,6 +4,14 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <tuple>
+#include <chrono>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
 
 
 namespace RawDesign {
@@ -184,3 +192,385 @@ TEST_CASE("Typical usage of an observer")
 }
 
 }
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  When the set of observers is known at compile time...
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+namespace StaticObserver {
+
+using DesignPatterns::NotificationChannel;
+
+//Observers are kept by value in a tuple and notified with a fold expression.
+//The compiler sees the concrete type of every observer, so there is no virtual call,
+//no shared_ptr and every notify() can be inlined into setValue().
+//The price: observers can't be attached or detached at run time.
+template<typename... Observers>
+class StaticStock
+{
+private:
+    double value;
+    std::tuple<Observers...> observers;
+public:
+    StaticStock() = default;
+    explicit StaticStock(Observers... theObservers) : observers(std::move(theObservers)...) {}
+
+    void valueChanged()
+    {
+        std::apply([this](auto&... observer) { (observer.notify(value), ...); }, observers);
+    }
+
+    void setValue(double newValue)
+    {
+        value = newValue;
+        valueChanged();
+    }
+
+    template<typename Observer>
+    Observer& get()
+    {
+        return std::get<Observer>(observers);
+    }
+
+    template<size_t Index>
+    auto& get()
+    {
+        return std::get<Index>(observers);
+    }
+};
+
+TEST_CASE("Typical usage of a static observer")
+{
+    //the very same channels as for the dynamic Stock
+    StaticStock<DesignPatterns::LcdScreen, DesignPatterns::Buzzer, DesignPatterns::SmsNotification> motoStock;
+
+    motoStock.setValue(1.0);
+    motoStock.setValue(5.1);
+}
+
+//Doesn't have to derive from NotificationChannel to be used by StaticStock, but it does,
+//so that the same class can be attached to the dynamic Stock in the benchmark below
+class Accumulator : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        sum += value;
+        ++count;
+    }
+    double sum = 0.0;
+    size_t count = 0;
+};
+
+TEST_CASE("Every observer of a static stock is notified in declaration order")
+{
+    struct First
+    {
+        void notify(double value) { order.push_back(1); }
+        std::vector<int>& order;
+    };
+    struct Second
+    {
+        void notify(double value) { order.push_back(2); }
+        std::vector<int>& order;
+    };
+
+    std::vector<int> order;
+    StaticStock<First, Second, Accumulator> stock(First{order}, Second{order}, Accumulator{});
+
+    stock.setValue(1.5);
+    stock.setValue(2.5);
+
+    CHECK(order == std::vector<int>{1, 2, 1, 2});
+    CHECK(stock.get<Accumulator>().sum == 4.0);
+    CHECK(stock.get<2>().count == 2);
+}
+
+TEST_CASE("Benchmark: dynamic Stock vs StaticStock" * doctest::skip())
+{
+    const size_t ticks = 20000000;
+
+    auto measure = [ticks](auto& stock) {
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < ticks; ++i)
+        {
+            stock.setValue(double(i & 1023));
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / ticks;
+    };
+
+    auto first  = std::make_shared<Accumulator>();
+    auto second = std::make_shared<Accumulator>();
+    auto third  = std::make_shared<Accumulator>();
+    DesignPatterns::Stock dynamicStock;
+    dynamicStock.attach(first);
+    dynamicStock.attach(second);
+    dynamicStock.attach(third);
+
+    StaticStock<Accumulator, Accumulator, Accumulator> staticStock;
+
+    const auto dynamicCost = measure(dynamicStock);
+    const auto staticCost = measure(staticStock);
+
+    std::cout << "Stock with 3 observers:       " << dynamicCost << " ns/tick\n";
+    std::cout << "StaticStock with 3 observers: " << staticCost << " ns/tick\n";
+
+    CHECK(first->count == ticks);
+    CHECK(staticStock.get<0>().count == ticks);
+    CHECK(first->sum == staticStock.get<0>().sum);
+}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  When an observer is just a lambda...
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+namespace CallbackObserver {
+
+using DesignPatterns::NotificationChannel;
+
+//Type-erased callable like std::function, but the callable is always stored in the object
+//itself - never on the heap. A callable which doesn't fit is a compile error, not an allocation.
+template<typename Signature, size_t Capacity = 48>
+class InplaceFunction;
+
+template<typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+{
+public:
+    InplaceFunction() = default;
+
+    template<typename F>
+        requires (!std::same_as<std::decay_t<F>, InplaceFunction> && std::invocable<std::decay_t<F>&, Args...>)
+    InplaceFunction(F&& callable)
+    {
+        using Stored = std::decay_t<F>;
+        static_assert(sizeof(Stored) <= Capacity, "Callable doesn't fit into InplaceFunction");
+        static_assert(alignof(Stored) <= alignof(std::max_align_t), "Callable is over-aligned");
+        static_assert(std::is_nothrow_move_constructible_v<Stored>, "Callable must be nothrow movable");
+
+        new(storage) Stored(std::forward<F>(callable));
+        invoker = [](void* stored, Args... args) -> R
+        {
+            return (*static_cast<Stored*>(stored))(std::forward<Args>(args)...);
+        };
+        manager = [](void* stored, void* target)
+        {
+            //moves into target, or just destroys when there is no target
+            if(target)
+            {
+                new(target) Stored(std::move(*static_cast<Stored*>(stored)));
+            }
+            static_cast<Stored*>(stored)->~Stored();
+        };
+    }
+
+    InplaceFunction(InplaceFunction&& other) noexcept
+    {
+        moveFrom(other);
+    }
+
+    InplaceFunction& operator=(InplaceFunction&& other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~InplaceFunction()
+    {
+        reset();
+    }
+
+    R operator()(Args... args)
+    {
+        return invoker(storage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const { return invoker != nullptr; }
+
+private:
+    void moveFrom(InplaceFunction& other)
+    {
+        if(other.manager)
+        {
+            other.manager(other.storage, storage);
+        }
+        invoker = std::exchange(other.invoker, nullptr);
+        manager = std::exchange(other.manager, nullptr);
+    }
+
+    void reset()
+    {
+        if(manager)
+        {
+            manager(storage, nullptr);
+        }
+        invoker = nullptr;
+        manager = nullptr;
+    }
+
+    alignas(std::max_align_t) unsigned char storage[Capacity];
+    R (*invoker)(void*, Args...) = nullptr;
+    void (*manager)(void*, void*) = nullptr;
+};
+
+//Observers are InplaceFunctions stored by value, one after another in a vector - notifying
+//them walks contiguous memory, with no shared_ptr control block and no pointer to chase.
+//A NotificationChannel can still be attached, it's then called through a small lambda.
+class Stock
+{
+public:
+    using Callback = InplaceFunction<void(double)>;
+    using Connection = std::uint64_t;
+
+private:
+    double value;
+    std::vector<Callback> observers;
+    std::vector<Connection> connections;    //parallel to observers, only used by detach()
+    Connection nextConnection = 0;
+
+public:
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer(value);
+        }
+    }
+
+    template<typename F>
+        requires std::invocable<std::decay_t<F>&, double>
+    Connection attach(F&& callback)
+    {
+        observers.emplace_back(std::forward<F>(callback));
+        connections.push_back(nextConnection);
+        return nextConnection++;
+    }
+
+    Connection attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        return attach([observer = std::move(newObserver)](double value) { observer->notify(value); });
+    }
+
+    void detach(Connection connection)
+    {
+        auto found = std::find(connections.begin(), connections.end(), connection);
+        if(found != connections.end())
+        {
+            observers.erase(observers.begin() + (found - connections.begin()));
+            connections.erase(found);
+        }
+    }
+
+    void setValue(double newValue)
+    {
+        //just for test purposes
+        value = newValue;
+        valueChanged();
+    }
+};
+
+static_assert(sizeof(Stock::Callback) == 64, "One observer per cache line");
+
+TEST_CASE("Typical usage of a callback observer")
+{
+    Stock motoStock;
+
+    motoStock.attach(std::make_shared<DesignPatterns::LcdScreen>());
+    auto buzzer = motoStock.attach([](double value) { std::cout << "Triggering Buzzer\n"; });
+    motoStock.attach([](double value) { std::cout << "Sending SmsNotification\n"; });
+
+    motoStock.setValue(1.0);
+    motoStock.detach(buzzer);
+    motoStock.setValue(5.1);
+}
+
+TEST_CASE("Callbacks keep their state, are notified in attach order and can be detached")
+{
+    std::vector<int> order;
+    double sum = 0.0;
+    Stock stock;
+    auto first = stock.attach([&order](double) { order.push_back(1); });
+    stock.attach([&order, &sum, calls = 0](double value) mutable { order.push_back(2); sum += value * ++calls; });
+    auto accumulator = std::make_shared<StaticObserver::Accumulator>();
+    stock.attach(accumulator);
+
+    stock.setValue(1.0);
+    stock.setValue(2.0);
+    stock.detach(first);
+    stock.setValue(3.0);
+
+    CHECK(order == std::vector<int>{1, 2, 1, 2, 2});
+    CHECK(sum == 1.0 + 4.0 + 9.0);
+    CHECK(accumulator->count == 3);
+}
+
+TEST_CASE("Move-only callables are moved with the dispatch array and destroyed on detach")
+{
+    auto tracker = std::make_shared<int>(0);
+    Stock stock;
+    std::vector<Stock::Connection> connections;
+    for(int i = 0; i < 100; ++i)
+    {
+        //the vector reallocates several times, every callable is moved, never copied
+        connections.push_back(stock.attach([owned = std::make_unique<int>(i), tracker](double) { ++*tracker; }));
+    }
+    CHECK(tracker.use_count() == 101);
+
+    stock.setValue(1.0);
+    CHECK(*tracker == 100);
+
+    for(auto connection : connections)
+    {
+        stock.detach(connection);
+    }
+    CHECK(tracker.use_count() == 1);
+    stock.setValue(2.0);
+    CHECK(*tracker == 100);
+}
+
+TEST_CASE("Benchmark: shared_ptr channels vs inline callbacks" * doctest::skip())
+{
+    const size_t ticks = 20000000;
+
+    auto measure = [ticks](auto& stock) {
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < ticks; ++i)
+        {
+            stock.setValue(double(i & 1023));
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / ticks;
+    };
+
+    DesignPatterns::Stock channelStock;
+    Stock callbackStock;
+    std::vector<double> sums(3);
+    for(size_t i = 0; i < 3; ++i)
+    {
+        channelStock.attach(std::make_shared<StaticObserver::Accumulator>());
+        callbackStock.attach([&sum = sums[i]](double value) { sum += value; });
+    }
+
+    const auto channelCost = measure(channelStock);
+    const auto callbackCost = measure(callbackStock);
+
+    std::cout << "Stock with 3 shared_ptr channels: " << channelCost << " ns/tick\n";
+    std::cout << "Stock with 3 inline callbacks:    " << callbackCost << " ns/tick\n";
+
+    CHECK(sums[0] == sums[2]);
+}
+
+}
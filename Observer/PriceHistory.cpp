@@ -0,0 +1,479 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+
+//Price history shared by the observers of a Stock
+//
+//Channels which need the past prices (charts, SMS digests) used to keep their own copy in a
+//std::vector<double>. Here the Stock keeps one PriceHistory and the channels query it.
+//
+//The history is compressed the way Facebook's Gorilla does it, in blocks of a fixed number of points:
+//- timestamps are stored as delta-of-delta - regular ticks take a single bit
+//- each value is XORed with the previous one - an unchanged price takes a single bit, a changed
+//  one only the bits which differ
+//A block knows its time range, so a range query decodes only the blocks it needs, each of them
+//from start to end in one tight loop.
+
+namespace PriceHistoryObserver {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+class BitWriter
+{
+public:
+    void write(std::uint64_t bits, unsigned count)
+    {
+        if(!count)
+        {
+            return;
+        }
+        if(count < 64)
+        {
+            bits &= (std::uint64_t(1) << count) - 1;
+        }
+        const unsigned offset = bitCount & 63;
+        if(offset == 0)
+        {
+            words.push_back(0);
+        }
+        const unsigned freeBits = 64 - offset;
+        if(count <= freeBits)
+        {
+            words.back() |= bits << (freeBits - count);
+        }
+        else
+        {
+            words.back() |= bits >> (count - freeBits);
+            words.push_back(bits << (64 - (count - freeBits)));
+        }
+        bitCount += count;
+    }
+
+    const std::vector<std::uint64_t>& data() const { return words; }
+    size_t size() const { return bitCount; }
+    void shrink() { words.shrink_to_fit(); }
+
+private:
+    std::vector<std::uint64_t> words;
+    size_t bitCount = 0;
+};
+
+class BitReader
+{
+public:
+    explicit BitReader(const std::vector<std::uint64_t>& theWords) : words(theWords.data()) {}
+
+    std::uint64_t read(unsigned count)
+    {
+        if(!count)
+        {
+            return 0;
+        }
+        const size_t word = position >> 6;
+        const unsigned offset = position & 63;
+        const unsigned available = 64 - offset;
+        position += count;
+        if(count <= available)
+        {
+            return (words[word] << offset) >> (64 - count);
+        }
+        const auto high = words[word] & ((std::uint64_t(1) << available) - 1);
+        const unsigned rest = count - available;
+        return (high << rest) | (words[word + 1] >> (64 - rest));
+    }
+
+    bool readBit() { return read(1); }
+
+private:
+    const std::uint64_t* words;
+    size_t position = 0;
+};
+
+struct PricePoint
+{
+    std::int64_t timestamp;
+    double value;
+
+    bool operator==(const PricePoint& other) const = default;
+};
+
+class PriceHistory
+{
+public:
+    explicit PriceHistory(size_t pointsPerBlock = 1024) : blockSize(pointsPerBlock) {}
+
+    //timestamps must not go back in time
+    void append(std::int64_t timestamp, double value)
+    {
+        if(!blocks.empty() && timestamp < blocks.back().lastTimestamp)
+        {
+            throw std::invalid_argument("PriceHistory accepts only increasing timestamps");
+        }
+        if(blocks.empty() || blocks.back().count == blockSize)
+        {
+            if(!blocks.empty())
+            {
+                blocks.back().bits.shrink();
+            }
+            startBlock(timestamp, value);
+            return;
+        }
+        auto& block = blocks.back();
+        encodeTimestamp(block.bits, timestamp);
+        encodeValue(block.bits, value);
+        block.lastTimestamp = timestamp;
+        ++block.count;
+        ++points;
+    }
+
+    //calls visit(timestamp, value) for every point within [from, to]
+    template<typename Visitor>
+    void forEach(std::int64_t from, std::int64_t to, Visitor visit) const
+    {
+        auto first = std::lower_bound(blocks.begin(), blocks.end(), from,
+                                      [](const Block& block, std::int64_t t) { return block.lastTimestamp < t; });
+        for(auto block = first; block != blocks.end() && block->firstTimestamp <= to; ++block)
+        {
+            decode(*block, [&](std::int64_t timestamp, double value) {
+                if(timestamp >= from && timestamp <= to)
+                {
+                    visit(timestamp, value);
+                }
+            });
+        }
+    }
+
+    std::vector<PricePoint> query(std::int64_t from, std::int64_t to) const
+    {
+        std::vector<PricePoint> result;
+        forEach(from, to, [&result](std::int64_t timestamp, double value) { result.push_back({timestamp, value}); });
+        return result;
+    }
+
+    size_t size() const { return points; }
+    std::int64_t lastTimestamp() const { return blocks.empty() ? 0 : blocks.back().lastTimestamp; }
+
+    size_t memoryUsage() const
+    {
+        size_t bytes = sizeof(*this) + blocks.capacity() * sizeof(Block);
+        for(const auto& block : blocks)
+        {
+            bytes += block.bits.data().capacity() * sizeof(std::uint64_t);
+        }
+        return bytes;
+    }
+
+private:
+    struct Block
+    {
+        std::int64_t firstTimestamp;
+        std::int64_t lastTimestamp;
+        size_t count;
+        BitWriter bits;
+    };
+
+    //delta-of-delta buckets: control bits, payload bits, smallest value which fits
+    struct Bucket
+    {
+        std::uint64_t control;
+        unsigned controlBits;
+        unsigned payloadBits;
+        std::int64_t lowest;
+    };
+    static constexpr Bucket buckets[] = {
+        {0b10, 2, 7, -63},
+        {0b110, 3, 9, -255},
+        {0b1110, 4, 12, -2047},
+    };
+
+    void startBlock(std::int64_t timestamp, double value)
+    {
+        blocks.push_back({timestamp, timestamp, 1, {}});
+        auto& bits = blocks.back().bits;
+        bits.write(static_cast<std::uint64_t>(timestamp), 64);
+        bits.write(std::bit_cast<std::uint64_t>(value), 64);
+        previousTimestamp = timestamp;
+        previousDelta = 0;
+        previousValue = std::bit_cast<std::uint64_t>(value);
+        previousLeading = 65;
+        previousTrailing = 0;
+        ++points;
+    }
+
+    void encodeTimestamp(BitWriter& bits, std::int64_t timestamp)
+    {
+        const std::int64_t delta = timestamp - previousTimestamp;
+        const std::int64_t deltaOfDelta = delta - previousDelta;
+        previousTimestamp = timestamp;
+        previousDelta = delta;
+
+        if(deltaOfDelta == 0)
+        {
+            bits.write(0, 1);
+            return;
+        }
+        for(const auto& bucket : buckets)
+        {
+            const std::int64_t highest = -bucket.lowest + 1;
+            if(deltaOfDelta >= bucket.lowest && deltaOfDelta <= highest)
+            {
+                bits.write(bucket.control, bucket.controlBits);
+                bits.write(static_cast<std::uint64_t>(deltaOfDelta - bucket.lowest), bucket.payloadBits);
+                return;
+            }
+        }
+        bits.write(0b1111, 4);
+        bits.write(static_cast<std::uint64_t>(deltaOfDelta), 64);
+    }
+
+    void encodeValue(BitWriter& bits, double value)
+    {
+        const auto current = std::bit_cast<std::uint64_t>(value);
+        const auto xored = current ^ previousValue;
+        previousValue = current;
+
+        if(xored == 0)
+        {
+            bits.write(0, 1);
+            return;
+        }
+        //5 bits are available for the number of leading zeros
+        const unsigned leading = std::min(std::countl_zero(xored), 31);
+        const unsigned trailing = std::countr_zero(xored);
+        if(previousLeading <= 64 && leading >= previousLeading && trailing >= previousTrailing)
+        {
+            //fits into the window of meaningful bits of the previous value
+            bits.write(0b10, 2);
+            bits.write(xored >> previousTrailing, 64 - previousLeading - previousTrailing);
+            return;
+        }
+        const unsigned meaningful = 64 - leading - trailing;
+        bits.write(0b11, 2);
+        bits.write(leading, 5);
+        bits.write(meaningful & 63, 6);     //64 is stored as 0
+        bits.write(xored >> trailing, meaningful);
+        previousLeading = leading;
+        previousTrailing = trailing;
+    }
+
+    template<typename Visitor>
+    static void decode(const Block& block, Visitor visit)
+    {
+        BitReader reader(block.bits.data());
+        auto timestamp = static_cast<std::int64_t>(reader.read(64));
+        auto value = reader.read(64);
+        std::int64_t delta = 0;
+        unsigned leading = 0;
+        unsigned trailing = 0;
+        visit(timestamp, std::bit_cast<double>(value));
+
+        for(size_t i = 1; i < block.count; ++i)
+        {
+            std::int64_t deltaOfDelta = 0;
+            if(reader.readBit())
+            {
+                size_t bucket = 0;
+                while(bucket < std::size(buckets) && reader.readBit())
+                {
+                    ++bucket;
+                }
+                if(bucket < std::size(buckets))
+                {
+                    deltaOfDelta = static_cast<std::int64_t>(reader.read(buckets[bucket].payloadBits))
+                                 + buckets[bucket].lowest;
+                }
+                else
+                {
+                    deltaOfDelta = static_cast<std::int64_t>(reader.read(64));
+                }
+            }
+            delta += deltaOfDelta;
+            timestamp += delta;
+
+            if(reader.readBit())
+            {
+                if(reader.readBit())
+                {
+                    leading = reader.read(5);
+                    const unsigned meaningful = reader.read(6);
+                    trailing = 64 - leading - (meaningful ? meaningful : 64);
+                }
+                value ^= reader.read(64 - leading - trailing) << trailing;
+            }
+            visit(timestamp, std::bit_cast<double>(value));
+        }
+    }
+
+    const size_t blockSize;
+    std::vector<Block> blocks;
+    size_t points = 0;
+
+    //encoder state of the last block
+    std::int64_t previousTimestamp = 0;
+    std::int64_t previousDelta = 0;
+    std::uint64_t previousValue = 0;
+    unsigned previousLeading = 65;      //no window yet
+    unsigned previousTrailing = 0;
+};
+
+class Stock
+{
+private:
+    double value = 0.0;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+    PriceHistory prices;
+public:
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer->notify(value);
+        }
+    }
+
+    void attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        observers.push_back(newObserver);
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+    }
+
+    //timestamp in milliseconds
+    void setValue(double newValue, std::int64_t timestamp)
+    {
+        value = newValue;
+        prices.append(timestamp, newValue);
+        valueChanged();
+    }
+
+    //timestamped with the wall clock, which may step back (NTP, manual change) - the history
+    //then gets the last timestamp again instead of an error
+    void setValue(double newValue)
+    {
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        const auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+        setValue(newValue, std::max<std::int64_t>(timestamp, prices.lastTimestamp()));
+    }
+
+    const PriceHistory& history() const { return prices; }
+};
+
+//Example of a channel reading the shared history instead of keeping its own
+class SmsDigest : public NotificationChannel
+{
+public:
+    SmsDigest(const PriceHistory& history, std::int64_t period) : prices(history), digestPeriod(period) {}
+
+    void notify(double value) override
+    {
+        if(++ticks % 10000)
+        {
+            return;
+        }
+        double low = value, high = value;
+        const auto last = prices.lastTimestamp();
+        prices.forEach(last - digestPeriod, last, [&](std::int64_t, double price) {
+            low = std::min(low, price);
+            high = std::max(high, price);
+        });
+        std::cout << "Sending SmsNotification: range " << low << " - " << high << "\n";
+    }
+
+private:
+    const PriceHistory& prices;
+    const std::int64_t digestPeriod;
+    size_t ticks = 0;
+};
+
+TEST_CASE("Compressed history returns exactly what was stored")
+{
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> jitter(-3, 3);
+    std::uniform_real_distribution<double> anything(-1e6, 1e6);
+
+    PriceHistory history(100);
+    std::vector<PricePoint> stored;
+    std::int64_t timestamp = 1500000000000;
+    for(int i = 0; i < 10000; ++i)
+    {
+        //regular ticks, jittered ticks, gaps and arbitrary values
+        timestamp += i % 500 == 0 ? 123456789 : 1000 + (i % 7 == 0 ? jitter(random) * 100 : 0);
+        const double value = i % 11 == 0 ? anything(random) : 100.0 + (i % 50) * 0.01;
+        history.append(timestamp, value);
+        stored.push_back({timestamp, value});
+    }
+
+    CHECK(history.size() == stored.size());
+    CHECK(history.query(INT64_MIN, INT64_MAX) == stored);
+
+    const auto from = stored[2345].timestamp;
+    const auto to = stored[7777].timestamp;
+    CHECK(history.query(from, to) == std::vector<PricePoint>(stored.begin() + 2345, stored.begin() + 7778));
+    CHECK(history.query(to + 1, to + 2).empty());
+
+    CHECK_THROWS_AS(history.append(from, 1.0), const std::invalid_argument&);
+}
+
+TEST_CASE("Wall clock stepping back doesn't break setValue")
+{
+    Stock stock;
+    //as if the clock had been an hour ahead when the last tick came
+    const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::system_clock::now().time_since_epoch()).count();
+    stock.setValue(1.0, now + 3600000);
+
+    CHECK_NOTHROW(stock.setValue(2.0));
+    CHECK(stock.history().size() == 2);
+    CHECK(stock.history().lastTimestamp() == now + 3600000);
+
+    //explicit timestamps are still checked
+    CHECK_THROWS_AS(stock.setValue(3.0, now), const std::invalid_argument&);
+}
+
+TEST_CASE("Typical price series takes a fraction of the raw size")
+{
+    std::mt19937 random(42);
+    std::bernoulli_distribution changes(0.2);
+    std::uniform_int_distribution<int> cents(-5, 5);
+
+    Stock motoStock;
+    motoStock.attach(std::make_shared<SmsDigest>(motoStock.history(), 60000));
+
+    const size_t ticks = 100000;
+    std::int64_t timestamp = 1500000000000;
+    int price = 10000;
+    for(size_t i = 0; i < ticks; ++i)
+    {
+        timestamp += 1000;
+        if(changes(random))
+        {
+            price += cents(random);
+        }
+        motoStock.setValue(price / 100.0, timestamp);
+    }
+
+    const auto raw = ticks * sizeof(PricePoint);
+    const auto compressed = motoStock.history().memoryUsage();
+    std::cout << "PriceHistory: " << raw << " bytes raw, " << compressed << " bytes compressed\n";
+
+    CHECK(motoStock.history().size() == ticks);
+    CHECK(compressed * 5 < raw);
+}
+
+}
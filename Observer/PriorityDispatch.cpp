@@ -0,0 +1,472 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+//Who gets notified first
+//
+//Stock::valueChanged() used to notify in attach order, so the safety-critical Buzzer could wait
+//behind a slow SmsNotification. Now every subscription has a DispatchPolicy:
+//- priority class - higher classes are notified first
+//- deadline - how long after the tick the channel should have it; within a class the channels
+//  with the tighter deadline go first, and every late delivery is counted
+//- budget - how long the channel's notify() may take
+//
+//A Normal or Low channel which overruns its budget several ticks in a row is demoted to the
+//background lane: a thread where it gets the latest price whenever it's ready for it, instead of
+//holding up the tick. Critical and High channels are never demoted - they only get their
+//overruns counted. All Stocks share one lane, unless they are given one of their own.
+
+namespace PriorityObserver {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Updating LcdScreen\n";
+    }
+};
+
+class Buzzer : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Triggering Buzzer\n";
+    }
+};
+
+class SmsNotification : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Sending SmsNotification\n";
+    }
+};
+
+enum class Priority
+{
+    Critical,
+    High,
+    Normal,
+    Low
+};
+
+struct DispatchPolicy
+{
+    using Duration = std::chrono::nanoseconds;
+
+    Priority priority = Priority::Normal;
+    Duration deadline = Duration::max();    //tick arrival to delivery
+    Duration budget = Duration::max();      //one notify() call
+};
+
+class Subscription
+{
+public:
+    Subscription(std::shared_ptr<NotificationChannel> subscriber, DispatchPolicy dispatchPolicy)
+        : channel(std::move(subscriber)), policy(dispatchPolicy) {}
+
+    const DispatchPolicy& getPolicy() const { return policy; }
+    bool isDemoted() const { return demoted.load(); }
+    size_t getDelivered() const { return delivered.load(); }
+    size_t getDeadlineMisses() const { return deadlineMisses.load(); }
+    size_t getOverruns() const { return overruns.load(); }
+
+private:
+    friend class Stock;
+    friend class BackgroundLane;
+
+    std::shared_ptr<NotificationChannel> channel;
+    const DispatchPolicy policy;
+    std::atomic<bool> demoted{false};
+    std::atomic<size_t> delivered{0};
+    std::atomic<size_t> deadlineMisses{0};
+    std::atomic<size_t> overruns{0};
+    size_t overrunsInRow = 0;
+
+    //guarded by the background lane
+    double pendingValue = 0.0;
+    bool queued = false;
+};
+
+//Thread notifying demoted channels; a channel slower than the ticks gets only the latest price
+class BackgroundLane
+{
+public:
+    BackgroundLane() : thread([this] { run(); }) {}
+
+    //the lane of Stocks not given one, alive while any of them uses it
+    static std::shared_ptr<BackgroundLane> shared()
+    {
+        static std::mutex mutex;
+        static std::weak_ptr<BackgroundLane> instance;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto lane = instance.lock();
+        if(!lane)
+        {
+            lane = std::make_shared<BackgroundLane>();
+            instance = lane;
+        }
+        return lane;
+    }
+
+    ~BackgroundLane()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        wakeUp.notify_all();
+        thread.join();
+    }
+
+    void post(const std::shared_ptr<Subscription>& subscription, double value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            subscription->pendingValue = value;
+            if(!subscription->queued)
+            {
+                subscription->queued = true;
+                queue.push_back(subscription);
+            }
+        }
+        wakeUp.notify_all();
+    }
+
+    //the subscription gets nothing more from the lane once this returns;
+    //not to be called from a notify() running on the lane
+    void remove(const std::shared_ptr<Subscription>& subscription)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        queue.erase(std::remove(queue.begin(), queue.end(), subscription), queue.end());
+        subscription->queued = false;
+        idle.wait(lock, [this, &subscription] { return current != subscription.get(); });
+    }
+
+    //blocks until all posted prices are delivered
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return queue.empty() && !current; });
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;)
+        {
+            wakeUp.wait(lock, [this] { return stopped || !queue.empty(); });
+            if(queue.empty())
+            {
+                return;
+            }
+            auto subscription = std::move(queue.front());
+            queue.pop_front();
+            subscription->queued = false;
+            const double value = subscription->pendingValue;
+            current = subscription.get();
+            lock.unlock();
+
+            subscription->channel->notify(value);
+            ++subscription->delivered;
+
+            lock.lock();
+            current = nullptr;
+            idle.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable idle;
+    std::deque<std::shared_ptr<Subscription>> queue;
+    Subscription* current = nullptr;        //being notified
+    bool stopped = false;
+    std::thread thread;
+};
+
+class Stock
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double value;
+    Clock::time_point tickArrival;
+    std::vector<std::shared_ptr<Subscription>> observers;   //in dispatch order
+    const size_t demoteAfter;
+    std::shared_ptr<BackgroundLane> background;
+
+    static bool dispatchedBefore(const std::shared_ptr<Subscription>& a, const std::shared_ptr<Subscription>& b)
+    {
+        if(a->policy.priority != b->policy.priority)
+        {
+            return a->policy.priority < b->policy.priority;
+        }
+        return a->policy.deadline < b->policy.deadline;
+    }
+
+    void demote(const std::shared_ptr<Subscription>& subscription)
+    {
+        if(!background)
+        {
+            background = BackgroundLane::shared();
+        }
+        subscription->demoted = true;
+    }
+
+public:
+    //a Normal or Low channel goes to the background lane after overrunsBeforeDemotion overruns in a row
+    explicit Stock(size_t overrunsBeforeDemotion = 3) : demoteAfter(overrunsBeforeDemotion) {}
+    Stock(std::shared_ptr<BackgroundLane> backgroundLane, size_t overrunsBeforeDemotion = 3)
+        : demoteAfter(overrunsBeforeDemotion), background(std::move(backgroundLane)) {}
+
+    ~Stock()
+    {
+        for(auto& observer : observers)
+        {
+            if(observer->demoted)
+            {
+                background->remove(observer);
+            }
+        }
+    }
+
+    Stock(const Stock&) = delete;
+    Stock& operator=(const Stock&) = delete;
+
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            if(observer->demoted)
+            {
+                background->post(observer, value);
+                continue;
+            }
+
+            const auto start = Clock::now();
+            observer->channel->notify(value);
+            const auto end = Clock::now();
+            ++observer->delivered;
+
+            if(end - tickArrival > observer->policy.deadline)
+            {
+                ++observer->deadlineMisses;
+            }
+            if(end - start <= observer->policy.budget)
+            {
+                observer->overrunsInRow = 0;
+                continue;
+            }
+            ++observer->overruns;
+            if(++observer->overrunsInRow >= demoteAfter && observer->policy.priority >= Priority::Normal)
+            {
+                demote(observer);
+            }
+        }
+    }
+
+    std::shared_ptr<Subscription> attach(std::shared_ptr<NotificationChannel> newObserver, DispatchPolicy policy = {})
+    {
+        auto subscription = std::make_shared<Subscription>(std::move(newObserver), policy);
+        //after the ones with the same policy - attach order still decides between equals
+        observers.insert(std::upper_bound(observers.begin(), observers.end(), subscription, dispatchedBefore),
+                         subscription);
+        return subscription;
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        auto matches = [&observer](const auto& s) { return s->channel == observer; };
+        for(auto& subscription : observers)
+        {
+            if(matches(subscription) && subscription->demoted)
+            {
+                background->remove(subscription);
+            }
+        }
+        observers.erase(std::remove_if(observers.begin(), observers.end(), matches), observers.end());
+    }
+
+    //arrival is when the tick entered the system, deadlines are counted from it
+    void setValue(double newValue, Clock::time_point arrival)
+    {
+        value = newValue;
+        tickArrival = arrival;
+        valueChanged();
+    }
+
+    void setValue(double newValue)
+    {
+        setValue(newValue, Clock::now());
+    }
+
+    //null until a channel is demoted
+    const std::shared_ptr<BackgroundLane>& getBackgroundLane() const { return background; }
+
+    //blocks until the demoted channels got the latest price
+    void waitIdle()
+    {
+        if(background)
+        {
+            background->waitIdle();
+        }
+    }
+};
+
+TEST_CASE("Buzzer goes first, whenever it was attached")
+{
+    using namespace std::chrono_literals;
+
+    Stock motoStock;
+    motoStock.attach(std::make_shared<SmsNotification>(), {Priority::Low, 5s, 10ms});
+    motoStock.attach(std::make_shared<LcdScreen>());
+    motoStock.attach(std::make_shared<Buzzer>(), {Priority::Critical, 1ms});
+
+    motoStock.setValue(1.0);
+    motoStock.setValue(5.1);
+}
+
+//remembers the order of notifications, optionally busy for a while in each
+struct RecordingChannel : public NotificationChannel
+{
+    RecordingChannel(std::vector<int>& theLog, int theId, std::chrono::microseconds theCost = {})
+        : log(theLog), id(theId), cost(theCost) {}
+
+    void notify(double value) override
+    {
+        const auto until = std::chrono::steady_clock::now() + cost;
+        while(std::chrono::steady_clock::now() < until)
+        {
+        }
+        log.push_back(id);
+        last = value;
+    }
+
+    std::vector<int>& log;
+    const int id;
+    const std::chrono::microseconds cost;
+    std::atomic<double> last{0.0};
+};
+
+TEST_CASE("Channels are notified by priority, then by deadline, then in attach order")
+{
+    using namespace std::chrono_literals;
+
+    std::vector<int> log;
+    Stock stock;
+    stock.attach(std::make_shared<RecordingChannel>(log, 1), {Priority::Low});
+    stock.attach(std::make_shared<RecordingChannel>(log, 2), {Priority::Normal, 50ms});
+    stock.attach(std::make_shared<RecordingChannel>(log, 3), {Priority::Critical});
+    stock.attach(std::make_shared<RecordingChannel>(log, 4), {Priority::Normal, 5ms});
+    stock.attach(std::make_shared<RecordingChannel>(log, 5), {Priority::Normal, 5ms});
+    stock.attach(std::make_shared<RecordingChannel>(log, 6));
+
+    stock.setValue(1.0);
+    CHECK(log == std::vector<int>{3, 4, 5, 2, 6, 1});
+}
+
+TEST_CASE("Slow low priority channel is moved to the background lane")
+{
+    using namespace std::chrono_literals;
+
+    std::vector<int> inlineLog, backgroundLog;
+    Stock stock;
+    auto sms = std::make_shared<RecordingChannel>(backgroundLog, 1, 2000us);
+    auto smsSubscription = stock.attach(sms, {Priority::Low, 1s, 100us});
+    auto buzzerSubscription = stock.attach(std::make_shared<RecordingChannel>(inlineLog, 2),
+                                           {Priority::Critical, 1s, 100us});
+
+    for(int i = 1; i <= 3; ++i)
+    {
+        stock.setValue(i);
+    }
+    CHECK(smsSubscription->isDemoted());
+    CHECK(smsSubscription->getOverruns() == 3);
+    CHECK(backgroundLog.size() == 3);
+
+    //the ticks don't wait for the SMS any more, it gets the latest price when it's ready
+    const auto start = std::chrono::steady_clock::now();
+    for(int i = 4; i <= 100; ++i)
+    {
+        stock.setValue(i);
+    }
+    CHECK(std::chrono::steady_clock::now() - start < 97 * 2000us);
+    CHECK(buzzerSubscription->getDelivered() == 100);
+
+    stock.waitIdle();
+    CHECK(sms->last == 100.0);
+    CHECK(smsSubscription->getDelivered() < 100);
+    CHECK_FALSE(buzzerSubscription->isDemoted());
+}
+
+TEST_CASE("Stocks share one background lane, detached channels leave it")
+{
+    using namespace std::chrono_literals;
+
+    std::vector<int> logA, logB;
+    Stock a(1), b(1);
+    auto slowA = std::make_shared<RecordingChannel>(logA, 1, 500us);
+    auto slowB = std::make_shared<RecordingChannel>(logB, 2, 500us);
+    a.attach(slowA, {Priority::Low, 1s, 100us});
+    b.attach(slowB, {Priority::Low, 1s, 100us});
+    a.setValue(1.0);
+    b.setValue(1.0);
+
+    REQUIRE(a.getBackgroundLane());
+    CHECK(a.getBackgroundLane() == b.getBackgroundLane());
+
+    for(int i = 2; i <= 50; ++i)
+    {
+        a.setValue(i);
+        b.setValue(i);
+    }
+    a.detach(slowA);
+    const auto deliveredBeforeDetach = logA.size();
+    b.waitIdle();
+
+    CHECK(logA.size() == deliveredBeforeDetach);
+    CHECK(slowB->last == 50.0);
+}
+
+TEST_CASE("Critical channels are never demoted, their overruns and deadline misses are counted")
+{
+    using namespace std::chrono_literals;
+
+    std::vector<int> log;
+    Stock stock(1);
+    auto slowFirst = stock.attach(std::make_shared<RecordingChannel>(log, 1, 300us), {Priority::Critical, 1s, 100us});
+    auto late = stock.attach(std::make_shared<RecordingChannel>(log, 2), {Priority::High, 200us});
+
+    for(int i = 0; i < 5; ++i)
+    {
+        stock.setValue(i);
+    }
+
+    CHECK_FALSE(slowFirst->isDemoted());
+    CHECK(slowFirst->getOverruns() == 5);
+    CHECK(slowFirst->getDeadlineMisses() == 0);
+    CHECK(late->getDeadlineMisses() == 5);
+    CHECK(log.size() == 10);
+}
+
+}
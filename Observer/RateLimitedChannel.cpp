@@ -0,0 +1,278 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+
+//Rate limited notifications
+//
+//SmsNotification fires on every price change - that is expensive, and the SMS gateway throttles
+//us anyway. RateLimitedChannel wraps any DigestChannel (decorating it, much like the windows in
+//Decorator.cpp) and lets a notification through only when its token bucket has a token.
+//
+//While throttled, price changes are not lost but coalesced: the next message that gets through
+//is a single digest (first, last, low, high, number of changes). So the number of messages stays
+//bounded by the bucket, however volatile the market is.
+
+namespace RateLimitedObserver {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+struct PriceDigest
+{
+    double first = 0.0;
+    double last = 0.0;
+    double low = std::numeric_limits<double>::infinity();
+    double high = -std::numeric_limits<double>::infinity();
+    size_t changes = 0;
+
+    void add(double value)
+    {
+        if(!changes)
+        {
+            first = value;
+        }
+        last = value;
+        low = std::min(low, value);
+        high = std::max(high, value);
+        ++changes;
+    }
+};
+
+//Channel able to send several price changes in one message
+class DigestChannel : public NotificationChannel
+{
+public:
+    virtual void notifyDigest(const PriceDigest& digest)
+    {
+        notify(digest.last);
+    }
+};
+
+class SmsNotification : public DigestChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Sending SmsNotification\n";
+    }
+
+    void notifyDigest(const PriceDigest& digest) override
+    {
+        std::cout << "Sending SmsNotification: " << digest.changes << " changes, "
+                  << digest.first << " -> " << digest.last
+                  << " (low " << digest.low << ", high " << digest.high << ")\n";
+    }
+};
+
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    //ratePerSecond tokens are added every second, at most burst of them are kept
+    TokenBucket(double ratePerSecond, double burst, Clock::time_point now = Clock::now())
+        : rate(ratePerSecond), capacity(burst), tokens(burst), lastRefill(now) {}
+
+    bool tryConsume(Clock::time_point now)
+    {
+        if(now > lastRefill)
+        {
+            tokens = std::min(capacity, tokens + rate * std::chrono::duration<double>(now - lastRefill).count());
+            lastRefill = now;
+        }
+        if(tokens < 1.0)
+        {
+            return false;
+        }
+        tokens -= 1.0;
+        return true;
+    }
+
+private:
+    const double rate;
+    const double capacity;
+    double tokens;
+    Clock::time_point lastRefill;
+};
+
+class RateLimitedChannel : public NotificationChannel
+{
+public:
+    using Clock = TokenBucket::Clock;
+
+    RateLimitedChannel(std::shared_ptr<DigestChannel> wrapped, double messagesPerSecond, double burst,
+                       std::function<Clock::time_point()> clock = Clock::now)
+        : channel(std::move(wrapped)), now(std::move(clock)), bucket(messagesPerSecond, burst, now()) {}
+
+    void notify(double value) override
+    {
+        pending.add(value);
+        if(!tryFlush())
+        {
+            ++throttled;
+        }
+    }
+
+    //sends the pending digest if a token is available - call it periodically (e.g. from a timer),
+    //otherwise the last changes before the market calms down are sent only with the next tick
+    bool tryFlush()
+    {
+        if(!pending.changes || !bucket.tryConsume(now()))
+        {
+            return false;
+        }
+        if(pending.changes == 1)
+        {
+            channel->notify(pending.last);
+        }
+        else
+        {
+            channel->notifyDigest(pending);
+        }
+        pending = PriceDigest{};
+        ++sent;
+        return true;
+    }
+
+    size_t getSent() const { return sent; }
+    size_t getThrottled() const { return throttled; }
+    size_t getPending() const { return pending.changes; }
+
+private:
+    std::shared_ptr<DigestChannel> channel;
+    std::function<Clock::time_point()> now;
+    TokenBucket bucket;
+    PriceDigest pending;
+    size_t sent = 0;
+    size_t throttled = 0;
+};
+
+class Stock
+{
+private:
+    double value;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+public:
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer->notify(value);
+        }
+    }
+
+    void attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        observers.push_back(newObserver);
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+    }
+
+    void setValue(double newValue)
+    {
+        //just for test purposes
+        value = newValue;
+        valueChanged();
+    }
+};
+
+TEST_CASE("Volatile market doesn't flood the SMS gateway")
+{
+    Stock motoStock;
+    motoStock.attach(std::make_shared<RateLimitedChannel>(std::make_shared<SmsNotification>(), 1.0, 2.0));
+
+    for(double value : {1.0, 1.2, 0.9, 1.5, 1.1, 1.3})
+    {
+        motoStock.setValue(value);
+    }
+}
+
+TEST_CASE("Throttled changes are coalesced into one digest")
+{
+    struct RecordingChannel : public DigestChannel
+    {
+        void notify(double value) override
+        {
+            singles.push_back(value);
+        }
+        void notifyDigest(const PriceDigest& digest) override
+        {
+            digests.push_back(digest);
+        }
+        std::vector<double> singles;
+        std::vector<PriceDigest> digests;
+    };
+
+    auto time = TokenBucket::Clock::time_point{};
+    auto sms = std::make_shared<RecordingChannel>();
+    RateLimitedChannel limited(sms, 1.0, 2.0, [&time] { return time; });
+
+    //burst of two goes through immediately
+    limited.notify(10.0);
+    limited.notify(11.0);
+    CHECK(sms->singles == std::vector<double>{10.0, 11.0});
+
+    //the rest of the second is throttled
+    for(double value : {12.0, 9.0, 15.0, 13.0})
+    {
+        time += std::chrono::milliseconds(100);
+        limited.notify(value);
+    }
+    CHECK(limited.getSent() == 2);
+    CHECK(limited.getThrottled() == 4);
+    CHECK(limited.getPending() == 4);
+    CHECK_FALSE(limited.tryFlush());
+
+    //a second later one token is back and the changes go out as one message
+    time += std::chrono::seconds(1);
+    CHECK(limited.tryFlush());
+    REQUIRE(sms->digests.size() == 1);
+    const auto& digest = sms->digests[0];
+    CHECK(digest.changes == 4);
+    CHECK(digest.first == 12.0);
+    CHECK(digest.last == 13.0);
+    CHECK(digest.low == 9.0);
+    CHECK(digest.high == 15.0);
+    CHECK(limited.getPending() == 0);
+    CHECK_FALSE(limited.tryFlush());
+}
+
+TEST_CASE("Message count is bounded by the token bucket")
+{
+    struct CountingChannel : public DigestChannel
+    {
+        void notify(double value) override { ++messages; }
+        void notifyDigest(const PriceDigest& digest) override { ++messages; changes += digest.changes; }
+        size_t messages = 0;
+        size_t changes = 0;
+    };
+
+    auto time = TokenBucket::Clock::time_point{};
+    auto sms = std::make_shared<CountingChannel>();
+    Stock stock;
+    stock.attach(std::make_shared<RateLimitedChannel>(sms, 5.0, 5.0, [&time] { return time; }));
+
+    //10 seconds of 1000 ticks per second
+    for(int i = 0; i < 10000; ++i)
+    {
+        time += std::chrono::milliseconds(1);
+        stock.setValue(100.0 + (i % 17));
+    }
+
+    CHECK(sms->messages <= 5 + 5 * 10);
+    CHECK(sms->messages >= 5 * 10);
+}
+
+}
@@ -0,0 +1,616 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <span>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <limits>
+
+//Analytics channels built on the Observer
+//
+//Instead of keeping the whole history and recomputing a window on every notify(), each of the
+//channels below keeps a ring-buffered window and updates its statistic in O(1) per tick:
+//
+//MovingAverage            - running sum of the window
+//ExponentialMovingAverage - no window at all
+//MovingVariance           - Welford's algorithm, adding the new and removing the oldest value
+//MovingMinMax             - monotonic deques, amortized O(1)
+//MovingVwap               - running sums of price*volume and volume
+//
+//When ticks arrive in bulk Stock::setValues() hands the whole batch to notifyBatch().
+//The channels which can, sum the batch in independent lanes the compiler turns into SIMD
+//instructions, and ignore everything older than one window.
+
+namespace RollingStatistics {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+
+    //channels interested in traded volume override this one
+    virtual void notifyTrade(double price, double volume)
+    {
+        notify(price);
+    }
+
+    //by default a batch is delivered tick by tick
+    virtual void notifyBatch(std::span<const double> prices, std::span<const double> volumes)
+    {
+        for(size_t i = 0; i < prices.size(); ++i)
+        {
+            notifyTrade(prices[i], volumes[i]);
+        }
+    }
+};
+
+class Stock
+{
+private:
+    double value = 0.0;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+public:
+    void attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        observers.push_back(newObserver);
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+    }
+
+    void setValue(double newValue, double volume = 1.0)
+    {
+        value = newValue;
+        for(auto& observer : observers)
+        {
+            observer->notifyTrade(value, volume);
+        }
+    }
+
+    void setValues(std::span<const double> prices, std::span<const double> volumes)
+    {
+        if(prices.size() != volumes.size())
+        {
+            throw std::invalid_argument("Every price needs its volume");
+        }
+        if(prices.empty())
+        {
+            return;
+        }
+        value = prices.back();
+        for(auto& observer : observers)
+        {
+            observer->notifyBatch(prices, volumes);
+        }
+    }
+
+    double getValue() const { return value; }
+};
+
+//Floating point addition isn't associative, so the compiler won't vectorize a plain sum loop
+//on its own. Accumulating into independent lanes gives it the freedom to.
+inline double laneSum(const double* values, size_t count)
+{
+    constexpr size_t lanes = 4;
+    double acc[lanes] = {};
+    size_t i = 0;
+    for(; i + lanes <= count; i += lanes)
+    {
+        for(size_t l = 0; l < lanes; ++l)
+        {
+            acc[l] += values[i + l];
+        }
+    }
+    for(; i < count; ++i)
+    {
+        acc[0] += values[i];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+inline double laneDot(const double* a, const double* b, size_t count)
+{
+    constexpr size_t lanes = 4;
+    double acc[lanes] = {};
+    size_t i = 0;
+    for(; i + lanes <= count; i += lanes)
+    {
+        for(size_t l = 0; l < lanes; ++l)
+        {
+            acc[l] += a[i + l] * b[i + l];
+        }
+    }
+    for(; i < count; ++i)
+    {
+        acc[0] += a[i] * b[i];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+//Fixed size ring of the last values, slots never written hold 0
+class Window
+{
+public:
+    explicit Window(size_t size) : buffer(size ? size : throw std::invalid_argument("Window can't be empty")) {}
+
+    //stores the value and returns the one it replaced
+    double push(double value)
+    {
+        const double oldest = buffer[next];
+        buffer[next] = value;
+        next = next + 1 == buffer.size() ? 0 : next + 1;
+        filled = std::min(filled + 1, buffer.size());
+        return oldest;
+    }
+
+    //stores a batch of values (at most size() of them), returns the sum of values replaced
+    double pushBatch(const double* values, size_t count)
+    {
+        double replaced = 0.0;
+        while(count)
+        {
+            const size_t chunk = std::min(count, buffer.size() - next);
+            replaced += laneSum(&buffer[next], chunk);
+            std::copy(values, values + chunk, &buffer[next]);
+            values += chunk;
+            count -= chunk;
+            filled = std::min(filled + chunk, buffer.size());
+            next = (next + chunk) % buffer.size();
+        }
+        return replaced;
+    }
+
+    //sum of the whole window, from scratch
+    double sum() const { return laneSum(buffer.data(), buffer.size()); }
+
+    //sum of the squared deviations of the whole window from mean, from scratch
+    double squaredDeviations(double mean) const
+    {
+        std::vector<double> deviations(buffer.size());
+        for(size_t i = 0; i < buffer.size(); ++i)
+        {
+            deviations[i] = buffer[i] - mean;
+        }
+        return laneDot(deviations.data(), deviations.data(), deviations.size());
+    }
+
+    bool full() const { return filled == buffer.size(); }
+    size_t count() const { return filled; }
+    size_t size() const { return buffer.size(); }
+
+private:
+    std::vector<double> buffer;
+    size_t next = 0;
+    size_t filled = 0;
+};
+
+class MovingAverage : public NotificationChannel
+{
+public:
+    explicit MovingAverage(size_t windowSize) : window(windowSize) {}
+
+    void notify(double value) override
+    {
+        sum += value - window.push(value);
+        if(++updatesSinceResum >= resumInterval)
+        {
+            resum();
+        }
+    }
+
+    void notifyBatch(std::span<const double> prices, std::span<const double> volumes) override
+    {
+        if(prices.size() >= window.size())
+        {
+            //older values would leave the window within this batch anyway
+            const auto recent = prices.last(window.size());
+            window.pushBatch(recent.data(), recent.size());
+            sum = laneSum(recent.data(), recent.size());
+            updatesSinceResum = 0;
+            return;
+        }
+        sum += laneSum(prices.data(), prices.size()) - window.pushBatch(prices.data(), prices.size());
+        updatesSinceResum += prices.size();
+        if(updatesSinceResum >= resumInterval)
+        {
+            resum();
+        }
+    }
+
+    double average() const { return window.count() ? sum / window.count() : 0.0; }
+    size_t count() const { return window.count(); }
+
+private:
+    //the running sum drifts with rounding errors, once in a while it's computed from scratch
+    void resum()
+    {
+        sum = window.sum();
+        updatesSinceResum = 0;
+    }
+
+    static constexpr size_t resumInterval = 1 << 16;
+
+    Window window;
+    double sum = 0.0;
+    size_t updatesSinceResum = 0;
+};
+
+class ExponentialMovingAverage : public NotificationChannel
+{
+public:
+    explicit ExponentialMovingAverage(double smoothing) : alpha(smoothing) {}
+
+    void notify(double value) override
+    {
+        smoothed = initialized ? smoothed + alpha * (value - smoothed) : value;
+        initialized = true;
+    }
+
+    double average() const { return smoothed; }
+
+private:
+    const double alpha;
+    double smoothed = 0.0;
+    bool initialized = false;
+};
+
+class MovingVariance : public NotificationChannel
+{
+public:
+    explicit MovingVariance(size_t windowSize) : window(windowSize) {}
+
+    void notify(double value) override
+    {
+        if(!window.full())
+        {
+            window.push(value);
+            const double delta = value - windowMean;
+            windowMean += delta / window.count();
+            m2 += delta * (value - windowMean);
+            ++updatesSinceResum;
+            return;
+        }
+        const double oldest = window.push(value);
+        const double oldMean = windowMean;
+        windowMean += (value - oldest) / window.size();
+        //rounding can take the sliding m2 below zero
+        m2 = std::max(m2 + (value - oldest) * (value - windowMean + oldest - oldMean), 0.0);
+        if(++updatesSinceResum >= resumInterval)
+        {
+            resum();
+        }
+    }
+
+    void notifyBatch(std::span<const double> prices, std::span<const double> volumes) override
+    {
+        if(prices.size() < window.size())
+        {
+            NotificationChannel::notifyBatch(prices, volumes);
+            return;
+        }
+        //whole window replaced - two pass over the last window, both passes vectorized
+        const auto recent = prices.last(window.size());
+        window.pushBatch(recent.data(), recent.size());
+        windowMean = laneSum(recent.data(), recent.size()) / recent.size();
+        m2 = window.squaredDeviations(windowMean);
+        updatesSinceResum = 0;
+    }
+
+    double mean() const { return windowMean; }
+    double variance() const { return window.count() > 1 ? m2 / (window.count() - 1) : 0.0; }
+
+private:
+    //like the sum of MovingAverage, the sliding mean and m2 drift; the window is full by now
+    void resum()
+    {
+        windowMean = window.sum() / window.size();
+        m2 = window.squaredDeviations(windowMean);
+        updatesSinceResum = 0;
+    }
+
+    static constexpr size_t resumInterval = 1 << 16;
+
+    Window window;
+    double windowMean = 0.0;
+    double m2 = 0.0;
+    size_t updatesSinceResum = 0;
+};
+
+class MovingMinMax : public NotificationChannel
+{
+public:
+    explicit MovingMinMax(size_t windowSize)
+        : size(windowSize ? windowSize : throw std::invalid_argument("Window can't be empty")) {}
+
+    void notify(double value) override
+    {
+        const size_t index = ticks++;
+        while(!minimums.empty() && minimums.back().value >= value)
+        {
+            minimums.pop_back();
+        }
+        minimums.push_back({index, value});
+        while(!maximums.empty() && maximums.back().value <= value)
+        {
+            maximums.pop_back();
+        }
+        maximums.push_back({index, value});
+
+        if(minimums.front().index + size <= index)
+        {
+            minimums.pop_front();
+        }
+        if(maximums.front().index + size <= index)
+        {
+            maximums.pop_front();
+        }
+    }
+
+    void notifyBatch(std::span<const double> prices, std::span<const double> volumes) override
+    {
+        //values older than one window can't become min or max anymore
+        const size_t skipped = prices.size() > size ? prices.size() - size : 0;
+        if(skipped)
+        {
+            ticks += skipped;
+            minimums.clear();
+            maximums.clear();
+        }
+        for(auto value : prices.subspan(skipped))
+        {
+            notify(value);
+        }
+    }
+
+    //NaN before the first tick
+    double min() const { return minimums.empty() ? std::numeric_limits<double>::quiet_NaN() : minimums.front().value; }
+    double max() const { return maximums.empty() ? std::numeric_limits<double>::quiet_NaN() : maximums.front().value; }
+
+private:
+    struct Entry
+    {
+        size_t index;
+        double value;
+    };
+
+    const size_t size;
+    size_t ticks = 0;
+    std::deque<Entry> minimums;
+    std::deque<Entry> maximums;
+};
+
+class MovingVwap : public NotificationChannel
+{
+public:
+    explicit MovingVwap(size_t windowSize) : turnovers(windowSize), volumes(windowSize) {}
+
+    void notify(double value) override
+    {
+        notifyTrade(value, 1.0);
+    }
+
+    void notifyTrade(double price, double volume) override
+    {
+        turnover += price * volume - turnovers.push(price * volume);
+        totalVolume += volume - volumes.push(volume);
+        if(++updatesSinceResum >= resumInterval)
+        {
+            resum();
+        }
+    }
+
+    void notifyBatch(std::span<const double> prices, std::span<const double> tradedVolumes) override
+    {
+        const bool replacesWindow = prices.size() >= volumes.size();
+        if(replacesWindow)
+        {
+            prices = prices.last(volumes.size());
+            tradedVolumes = tradedVolumes.last(volumes.size());
+        }
+        std::vector<double> batchTurnovers(prices.size());
+        for(size_t i = 0; i < prices.size(); ++i)
+        {
+            batchTurnovers[i] = prices[i] * tradedVolumes[i];
+        }
+        const double replacedTurnover = turnovers.pushBatch(batchTurnovers.data(), batchTurnovers.size());
+        const double replacedVolume = volumes.pushBatch(tradedVolumes.data(), tradedVolumes.size());
+        if(replacesWindow)
+        {
+            turnover = laneSum(batchTurnovers.data(), batchTurnovers.size());
+            totalVolume = laneSum(tradedVolumes.data(), tradedVolumes.size());
+            updatesSinceResum = 0;
+            return;
+        }
+        turnover += laneSum(batchTurnovers.data(), batchTurnovers.size()) - replacedTurnover;
+        totalVolume += laneSum(tradedVolumes.data(), tradedVolumes.size()) - replacedVolume;
+        updatesSinceResum += prices.size();
+        if(updatesSinceResum >= resumInterval)
+        {
+            resum();
+        }
+    }
+
+    double vwap() const { return totalVolume > 0.0 ? turnover / totalVolume : 0.0; }
+
+private:
+    void resum()
+    {
+        turnover = turnovers.sum();
+        totalVolume = volumes.sum();
+        updatesSinceResum = 0;
+    }
+
+    static constexpr size_t resumInterval = 1 << 16;
+
+    Window turnovers;
+    Window volumes;
+    double turnover = 0.0;
+    double totalVolume = 0.0;
+    size_t updatesSinceResum = 0;
+};
+
+TEST_CASE("Analytics channels attached to a stock")
+{
+    auto average = std::make_shared<MovingAverage>(3);
+    auto minMax = std::make_shared<MovingMinMax>(3);
+    auto vwap = std::make_shared<MovingVwap>(3);
+
+    Stock motoStock;
+    motoStock.attach(average);
+    motoStock.attach(minMax);
+    motoStock.attach(vwap);
+
+    motoStock.setValue(1.0, 100);
+    motoStock.setValue(2.0, 100);
+    motoStock.setValue(6.0, 200);
+    motoStock.setValue(4.0, 100);
+
+    CHECK(average->average() == doctest::Approx(4.0));
+    CHECK(minMax->min() == 2.0);
+    CHECK(minMax->max() == 6.0);
+    CHECK(vwap->vwap() == doctest::Approx((2.0 * 100 + 6.0 * 200 + 4.0 * 100) / 400));
+}
+
+TEST_CASE("Running sum of the moving average doesn't drift")
+{
+    //values of very different magnitude make every add and subtract round;
+    //the last of 16 * 65536 ticks is when the sum is recomputed
+    MovingAverage average(4);
+    for(int i = 0; i < 16 * 65536 - 4; ++i)
+    {
+        average.notify(i % 2 ? 1e8 + 0.1 : 0.3);
+    }
+    for(int i = 0; i < 4; ++i)
+    {
+        average.notify(1.0);
+    }
+    CHECK(average.average() == doctest::Approx(1.0).epsilon(1e-12));
+}
+
+TEST_CASE("Running sums of variance and VWAP don't drift either")
+{
+    //as above, the 16 * 65536th update recomputes them
+    MovingVariance variance(4);
+    MovingVwap vwap(4);
+    for(int i = 0; i < 16 * 65536 - 4; ++i)
+    {
+        variance.notify(i % 2 ? 1e8 + 0.1 : 0.3);
+        vwap.notifyTrade(i % 2 ? 1e8 + 0.1 : 0.3, i % 2 ? 0.7 : 1e6);
+    }
+    for(int i = 0; i < 4; ++i)
+    {
+        variance.notify(1.0);
+        vwap.notifyTrade(1.0, 1.0);
+    }
+    CHECK(variance.mean() == doctest::Approx(1.0).epsilon(1e-12));
+    CHECK(variance.variance() == 0.0);
+    CHECK(vwap.vwap() == doctest::Approx(1.0).epsilon(1e-12));
+}
+
+TEST_CASE("Min and max of an empty window")
+{
+    MovingMinMax minMax(3);
+    CHECK(std::isnan(minMax.min()));
+    CHECK(std::isnan(minMax.max()));
+    minMax.notify(2.0);
+    CHECK(minMax.min() == 2.0);
+    CHECK(minMax.max() == 2.0);
+
+    CHECK_THROWS_AS(MovingMinMax(0), const std::invalid_argument&);
+}
+
+TEST_CASE("Rolling statistics match a recomputation from scratch")
+{
+    const size_t windowSize = 37;
+    std::mt19937 random(42);
+    std::normal_distribution<double> step(0.0, 1.0);
+    std::uniform_real_distribution<double> size(1.0, 500.0);
+
+    auto average = std::make_shared<MovingAverage>(windowSize);
+    auto ema = std::make_shared<ExponentialMovingAverage>(0.1);
+    auto variance = std::make_shared<MovingVariance>(windowSize);
+    auto minMax = std::make_shared<MovingMinMax>(windowSize);
+    auto vwap = std::make_shared<MovingVwap>(windowSize);
+
+    Stock stock;
+    for(auto channel : std::vector<std::shared_ptr<NotificationChannel>>{average, ema, variance, minMax, vwap})
+    {
+        stock.attach(channel);
+    }
+
+    std::vector<double> prices;
+    std::vector<double> volumes;
+    double price = 100.0;
+    double expectedEma = 0.0;
+
+    auto check = [&] {
+        const auto from = prices.size() > windowSize ? prices.size() - windowSize : 0;
+        const auto n = double(prices.size() - from);
+        double sum = 0.0, turnover = 0.0, volume = 0.0;
+        for(auto i = from; i < prices.size(); ++i)
+        {
+            sum += prices[i];
+            turnover += prices[i] * volumes[i];
+            volume += volumes[i];
+        }
+        const double mean = sum / n;
+        double m2 = 0.0;
+        for(auto i = from; i < prices.size(); ++i)
+        {
+            m2 += (prices[i] - mean) * (prices[i] - mean);
+        }
+        CHECK(average->average() == doctest::Approx(mean));
+        CHECK(variance->variance() == doctest::Approx(m2 / (n - 1)).epsilon(1e-6));
+        CHECK(minMax->min() == *std::min_element(prices.begin() + from, prices.end()));
+        CHECK(minMax->max() == *std::max_element(prices.begin() + from, prices.end()));
+        CHECK(vwap->vwap() == doctest::Approx(turnover / volume));
+        CHECK(ema->average() == doctest::Approx(expectedEma));
+    };
+
+    auto nextTrade = [&] {
+        price += step(random);
+        prices.push_back(price);
+        volumes.push_back(std::round(size(random)));
+        expectedEma = prices.size() == 1 ? price : expectedEma + 0.1 * (price - expectedEma);
+    };
+
+    SUBCASE("tick by tick")
+    {
+        for(int i = 0; i < 1000; ++i)
+        {
+            nextTrade();
+            stock.setValue(prices.back(), volumes.back());
+            if(prices.size() > 1)
+            {
+                check();
+            }
+        }
+    }
+
+    SUBCASE("in batches")
+    {
+        for(size_t batchSize : {1, 5, 36, 37, 38, 100, 3, 250, 17})
+        {
+            const auto first = prices.size();
+            for(size_t i = 0; i < batchSize; ++i)
+            {
+                nextTrade();
+            }
+            stock.setValues(std::span<const double>(prices).subspan(first),
+                            std::span<const double>(volumes).subspan(first));
+            if(prices.size() > 1)
+            {
+                check();
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,416 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//Stock updates for other processes
+//
+//The LCD renderer and the alerting daemons run as separate processes. Instead of each of them
+//reading the feed, SharedMemoryChannel is attached to the Stock like any other channel and
+//writes every update into a broadcast ring in POSIX shared memory. Any number of
+//SharedMemorySubscribers map the same ring read-only and follow it at their own pace.
+//
+//There is one writer and it never waits for the readers:
+//- every slot is a small seqlock - its sequence is odd while the slot is written, and tells the
+//  reader which update the slot holds
+//- a reader which fell more than a whole ring behind skips ahead and counts the updates it lost
+//- reading is plain loads from the mapping, no system calls and no copies through the kernel
+
+namespace SharedMemoryObserver {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+using SymbolId = std::uint32_t;
+
+struct Update
+{
+    std::uint64_t sequence;     //position in the stream of all published updates
+    SymbolId symbol;
+    double value;
+};
+
+namespace Layout {
+
+constexpr std::uint64_t magic = 0x474e49524b434f54;     //"TOCKRING"
+
+//fields are atomics (lock-free, so valid across processes) so readers racing with the writer
+//are well defined - whatever they read is thrown away if the sequence changed meanwhile
+struct alignas(64) Slot
+{
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint64_t> symbol;
+    std::atomic<std::uint64_t> value;
+};
+
+struct alignas(64) Header
+{
+    std::uint64_t magic;
+    std::uint64_t capacity;
+    alignas(64) std::atomic<std::uint64_t> published;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+inline size_t sizeFor(std::uint64_t capacity)
+{
+    return sizeof(Header) + capacity * sizeof(Slot);
+}
+
+inline Slot* slots(const Header* header)
+{
+    return reinterpret_cast<Slot*>(reinterpret_cast<std::uintptr_t>(header) + sizeof(Header));
+}
+
+}
+
+class SharedMemoryPublisher
+{
+public:
+    //name as for shm_open, e.g. "/stock-ticks"; capacity must be a power of two
+    SharedMemoryPublisher(std::string segmentName, std::uint64_t capacity = 1 << 16) : name(std::move(segmentName))
+    {
+        if(!std::has_single_bit(capacity))
+        {
+            throw std::invalid_argument("Ring capacity must be a power of two");
+        }
+        size = Layout::sizeFor(capacity);
+        const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if(fd < 0)
+        {
+            throw std::runtime_error("Can't create shared memory " + name + ": " + std::strerror(errno));
+        }
+        void* memory = MAP_FAILED;
+        if(::ftruncate(fd, size) == 0)
+        {
+            memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        //close and shm_unlink may change errno
+        const int mapError = errno;
+        ::close(fd);
+        if(memory == MAP_FAILED)
+        {
+            ::shm_unlink(name.c_str());
+            throw std::runtime_error("Can't map shared memory " + name + ": " + std::strerror(mapError));
+        }
+
+        //fresh memory is zeroed, so all slots say "nothing written yet"
+        header = static_cast<Layout::Header*>(memory);
+        header->capacity = capacity;
+        header->published.store(0, std::memory_order_relaxed);
+        slots = Layout::slots(header);
+        mask = capacity - 1;
+        //magic last - subscribers refuse the segment until it's ready
+        std::atomic_ref<std::uint64_t>(header->magic).store(Layout::magic, std::memory_order_release);
+    }
+
+    ~SharedMemoryPublisher()
+    {
+        //processes which have it mapped keep reading what is there
+        ::munmap(header, size);
+        ::shm_unlink(name.c_str());
+    }
+
+    SharedMemoryPublisher(const SharedMemoryPublisher&) = delete;
+    SharedMemoryPublisher& operator=(const SharedMemoryPublisher&) = delete;
+
+    //single writer only
+    void publish(SymbolId symbol, double value)
+    {
+        auto& slot = slots[next & mask];
+        //release on the data keeps the odd sequence ahead of it
+        slot.sequence.store(2 * next + 1, std::memory_order_relaxed);
+        slot.symbol.store(symbol, std::memory_order_release);
+        slot.value.store(std::bit_cast<std::uint64_t>(value), std::memory_order_release);
+        slot.sequence.store(2 * next + 2, std::memory_order_release);
+        header->published.store(++next, std::memory_order_release);
+    }
+
+    std::uint64_t getPublished() const { return next; }
+
+private:
+    const std::string name;
+    size_t size;
+    Layout::Header* header;
+    Layout::Slot* slots;
+    std::uint64_t mask;
+    std::uint64_t next = 0;
+};
+
+class SharedMemoryChannel : public NotificationChannel
+{
+public:
+    SharedMemoryChannel(SharedMemoryPublisher& ringPublisher, SymbolId stockSymbol)
+        : publisher(ringPublisher), symbol(stockSymbol) {}
+
+    void notify(double value) override
+    {
+        publisher.publish(symbol, value);
+    }
+
+private:
+    SharedMemoryPublisher& publisher;
+    const SymbolId symbol;
+};
+
+class SharedMemorySubscriber
+{
+public:
+    enum class Start
+    {
+        Latest,     //only updates published from now on
+        Oldest      //also the ones still in the ring
+    };
+
+    explicit SharedMemorySubscriber(const std::string& name, Start start = Start::Latest)
+    {
+        const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if(fd < 0)
+        {
+            throw std::runtime_error("Can't open shared memory " + name + ": " + std::strerror(errno));
+        }
+        struct stat status{};
+        void* memory = MAP_FAILED;
+        if(::fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Layout::Header))
+        {
+            size = status.st_size;
+            memory = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if(memory == MAP_FAILED)
+        {
+            throw std::runtime_error("Can't map shared memory " + name);
+        }
+        header = static_cast<const Layout::Header*>(memory);
+        if(std::atomic_ref<const std::uint64_t>(header->magic).load(std::memory_order_acquire) != Layout::magic
+           || size < Layout::sizeFor(header->capacity))
+        {
+            ::munmap(memory, size);
+            throw std::runtime_error("Shared memory " + name + " is not a tick ring");
+        }
+        capacity = header->capacity;
+        slots = Layout::slots(header);
+
+        const auto published = header->published.load(std::memory_order_acquire);
+        cursor = start == Start::Latest ? published : published - std::min(published, capacity);
+    }
+
+    ~SharedMemorySubscriber()
+    {
+        ::munmap(const_cast<Layout::Header*>(header), size);
+    }
+
+    SharedMemorySubscriber(const SharedMemorySubscriber&) = delete;
+    SharedMemorySubscriber& operator=(const SharedMemorySubscriber&) = delete;
+
+    //next update, false when the reader caught up with the writer
+    bool tryRead(Update& update)
+    {
+        for(;;)
+        {
+            const auto published = header->published.load(std::memory_order_acquire);
+            if(cursor >= published)
+            {
+                return false;
+            }
+            if(published - cursor > capacity)
+            {
+                lost += published - capacity - cursor;
+                cursor = published - capacity;
+            }
+
+            const auto& slot = slots[cursor & (capacity - 1)];
+            const auto expected = 2 * cursor + 2;
+            const auto before = slot.sequence.load(std::memory_order_acquire);
+            //acquire on the data keeps the second look at the sequence behind it
+            const auto symbol = slot.symbol.load(std::memory_order_acquire);
+            const auto value = slot.value.load(std::memory_order_acquire);
+            const auto after = slot.sequence.load(std::memory_order_relaxed);
+            if(before != expected || after != expected)
+            {
+                //the writer lapped us while we were reading the slot
+                ++lost;
+                ++cursor;
+                continue;
+            }
+            update = {cursor++, static_cast<SymbolId>(symbol), std::bit_cast<double>(value)};
+            return true;
+        }
+    }
+
+    //hands every available update to the callback, returns how many there were
+    template<typename Callback>
+    size_t poll(Callback&& callback)
+    {
+        size_t count = 0;
+        for(Update update; tryRead(update); ++count)
+        {
+            callback(update);
+        }
+        return count;
+    }
+
+    std::uint64_t getLost() const { return lost; }
+    //sequence of the next update to read
+    std::uint64_t getPosition() const { return cursor; }
+
+private:
+    size_t size = 0;
+    const Layout::Header* header;
+    const Layout::Slot* slots;
+    std::uint64_t capacity;
+    std::uint64_t cursor;
+    std::uint64_t lost = 0;
+};
+
+class Stock
+{
+private:
+    double value;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+public:
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer->notify(value);
+        }
+    }
+
+    void attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        observers.push_back(newObserver);
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+    }
+
+    void setValue(double newValue)
+    {
+        //just for test purposes
+        value = newValue;
+        valueChanged();
+    }
+};
+
+inline std::string testSegmentName(const std::string& name)
+{
+    return "/" + name + "." + std::to_string(::getpid());
+}
+
+TEST_CASE("Subscribers read Stock updates from shared memory")
+{
+    const auto name = testSegmentName("shm_fanout_test");
+    SharedMemoryPublisher publisher(name, 8);
+    Stock moto, nokia;
+    moto.attach(std::make_shared<SharedMemoryChannel>(publisher, 1));
+    nokia.attach(std::make_shared<SharedMemoryChannel>(publisher, 2));
+
+    moto.setValue(1.0);
+    SharedMemorySubscriber lcd(name);
+    SharedMemorySubscriber alerts(name, SharedMemorySubscriber::Start::Oldest);
+
+    moto.setValue(1.5);
+    nokia.setValue(20.0);
+
+    std::vector<std::pair<SymbolId, double>> lcdUpdates, alertUpdates;
+    lcd.poll([&](const Update& u) { lcdUpdates.emplace_back(u.symbol, u.value); });
+    alerts.poll([&](const Update& u) { alertUpdates.emplace_back(u.symbol, u.value); });
+
+    CHECK(lcdUpdates == std::vector<std::pair<SymbolId, double>>{{1, 1.5}, {2, 20.0}});
+    CHECK(alertUpdates == std::vector<std::pair<SymbolId, double>>{{1, 1.0}, {1, 1.5}, {2, 20.0}});
+
+    Update update;
+    CHECK_FALSE(lcd.tryRead(update));
+}
+
+TEST_CASE("Slow subscriber skips what was overwritten and counts it")
+{
+    const auto name = testSegmentName("shm_fanout_lapped_test");
+    SharedMemoryPublisher publisher(name, 8);
+    SharedMemorySubscriber slow(name);
+
+    for(int i = 0; i < 20; ++i)
+    {
+        publisher.publish(7, i);
+    }
+
+    std::vector<double> values;
+    slow.poll([&](const Update& u) { values.push_back(u.value); });
+
+    CHECK(slow.getLost() == 12);
+    CHECK(values == std::vector<double>{12, 13, 14, 15, 16, 17, 18, 19});
+}
+
+TEST_CASE("Subscriber refuses a segment which isn't a tick ring")
+{
+    CHECK_THROWS_AS(SharedMemorySubscriber(testSegmentName("shm_fanout_missing")), const std::runtime_error&);
+}
+
+TEST_CASE("Another process follows the updates while they are published")
+{
+    const auto name = testSegmentName("shm_fanout_process_test");
+    const int updates = 200000;
+    SharedMemoryPublisher publisher(name, 1 << 12);
+
+    const pid_t child = ::fork();
+    REQUIRE(child >= 0);
+    if(child == 0)
+    {
+        //the subscriber process: every update it sees comes in order, the missed ones are counted
+        int status = 1;
+        try
+        {
+            SharedMemorySubscriber subscriber(name, SharedMemorySubscriber::Start::Oldest);
+            const auto first = subscriber.getPosition();
+            std::uint64_t seen = 0;
+            double last = -1.0;
+            bool ordered = true;
+            while(last != updates - 1)
+            {
+                subscriber.poll([&](const Update& u)
+                {
+                    ordered = ordered && u.value > last && u.value == static_cast<double>(u.sequence);
+                    last = u.value;
+                    ++seen;
+                });
+            }
+            status = ordered && first + seen + subscriber.getLost() == updates ? 0 : 1;
+        }
+        catch(...)
+        {
+        }
+        ::_exit(status);
+    }
+
+    for(int i = 0; i < updates; ++i)
+    {
+        publisher.publish(1, i);
+    }
+
+    int status = 0;
+    REQUIRE(::waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == 0);
+}
+
+}
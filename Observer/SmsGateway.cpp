@@ -0,0 +1,647 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//SmsNotification talking to a real gateway
+//
+//Sending an SMS means network I/O, and the notifier must never wait for it. SmsGatewayClient
+//keeps a non-blocking UNIX socket to the gateway:
+//- notify() only appends the request to the outgoing queue and tries a non-blocking writev()
+//  of everything queued - many requests leave in one system call
+//- if the gateway goes away, whatever it hasn't confirmed and every later request is dropped
+//  and counted; notify() keeps going
+//- requests are pipelined, the client doesn't wait for a reply before sending the next one
+//- poll() (called from the application's event loop) waits with epoll for the socket to
+//  become writable or readable, and matches the replies to the requests in flight
+//
+//Protocol, one line each:   SMS <id> <text>   ->   OK <id>
+//
+//StandInSmsGateway is a local server speaking the same protocol, used by the tests and the
+//throughput benchmark instead of the real gateway.
+
+namespace SmsGateway {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+inline std::runtime_error systemError(const std::string& what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+inline sockaddr_un unixAddress(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+    {
+        throw std::invalid_argument("Socket path too long: " + path);
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+class SmsGatewayClient
+{
+public:
+    explicit SmsGatewayClient(const std::string& socketPath, size_t maxQueuedBytes = 1 << 20)
+        : queueLimit(maxQueuedBytes)
+    {
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0)
+        {
+            throw systemError("Can't create socket");
+        }
+        //connecting to a local socket doesn't block for long, the rest of the I/O never blocks
+        const auto address = unixAddress(socketPath);
+        if(::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+        {
+            ::close(fd);
+            throw systemError("Can't connect to SMS gateway " + socketPath);
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if(epollFd < 0 || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            const auto error = systemError("Can't set up epoll");
+            ::close(fd);
+            if(epollFd >= 0)
+            {
+                ::close(epollFd);
+            }
+            throw error;
+        }
+    }
+
+    ~SmsGatewayClient()
+    {
+        ::close(epollFd);
+        ::close(fd);
+    }
+
+    SmsGatewayClient(const SmsGatewayClient&) = delete;
+    SmsGatewayClient& operator=(const SmsGatewayClient&) = delete;
+
+    //never blocks, returns false when the message has been dropped - the queue is full or the
+    //gateway is gone
+    bool send(std::string text)
+    {
+        std::replace(text.begin(), text.end(), '\n', ' ');
+        auto request = "SMS " + std::to_string(nextId) + " " + text + "\n";
+        if(!connected || queuedBytes + request.size() > queueLimit)
+        {
+            ++dropped;
+            return false;
+        }
+        ++nextId;
+        queuedBytes += request.size();
+        outgoing.push_back(std::move(request));
+        flush();
+        return true;
+    }
+
+    //waits up to timeoutMs for the socket and handles whatever is ready
+    void poll(int timeoutMs)
+    {
+        if(!connected)
+        {
+            return;
+        }
+        epoll_event events[4];
+        const int ready = ::epoll_wait(epollFd, events, 4, timeoutMs);
+        if(ready < 0 && errno != EINTR)
+        {
+            throw systemError("epoll_wait failed");
+        }
+        for(int i = 0; i < ready; ++i)
+        {
+            if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                readReplies();
+            }
+            if(connected && (events[i].events & EPOLLOUT))
+            {
+                flush();
+            }
+        }
+    }
+
+    size_t getWritten() const { return written; }
+    size_t getAcknowledged() const { return acknowledged; }
+    //messages the gateway never confirmed: the queue was full, or the gateway went away
+    size_t getDropped() const { return dropped; }
+    bool isConnected() const { return connected; }
+    size_t inFlight() const { return nextId - acknowledged; }
+
+private:
+    void flush()
+    {
+        while(!outgoing.empty())
+        {
+            iovec parts[64];
+            int count = 0;
+            for(auto it = outgoing.begin(); it != outgoing.end() && count < 64; ++it, ++count)
+            {
+                const size_t skip = count == 0 ? outgoingOffset : 0;
+                parts[count].iov_base = it->data() + skip;
+                parts[count].iov_len = it->size() - skip;
+            }
+            //writev() with MSG_NOSIGNAL - a gateway which went away must not kill us with SIGPIPE
+            msghdr message{};
+            message.msg_iov = parts;
+            message.msg_iovlen = count;
+            auto bytes = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+            if(bytes < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                if(errno == EPIPE || errno == ECONNRESET)
+                {
+                    disconnect();
+                    return;
+                }
+                throw systemError("Can't write to SMS gateway");
+            }
+            queuedBytes -= bytes;
+            while(bytes > 0)
+            {
+                const size_t remaining = outgoing.front().size() - outgoingOffset;
+                if(static_cast<size_t>(bytes) < remaining)
+                {
+                    outgoingOffset += bytes;
+                    break;
+                }
+                bytes -= remaining;
+                outgoing.pop_front();
+                outgoingOffset = 0;
+                ++written;
+            }
+        }
+        watchWritable(!outgoing.empty());
+    }
+
+    //the gateway is gone: whatever it hasn't confirmed is dropped, and so is everything sent later
+    void disconnect()
+    {
+        connected = false;
+        ::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        dropped += nextId - acknowledged;
+        nextId = acknowledged;
+        outgoing.clear();
+        outgoingOffset = 0;
+        queuedBytes = 0;
+    }
+
+    void watchWritable(bool writable)
+    {
+        if(writable == watchingWritable)
+        {
+            return;
+        }
+        epoll_event event{};
+        event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        event.data.fd = fd;
+        ::epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+        watchingWritable = writable;
+    }
+
+    void readReplies()
+    {
+        char buffer[4096];
+        for(;;)
+        {
+            const auto bytes = ::read(fd, buffer, sizeof(buffer));
+            if(bytes < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                if(errno == ECONNRESET)
+                {
+                    disconnect();
+                    return;
+                }
+                throw systemError("Can't read from SMS gateway");
+            }
+            if(bytes == 0)
+            {
+                disconnect();
+                return;
+            }
+            input.append(buffer, bytes);
+        }
+
+        size_t start = 0;
+        for(auto end = input.find('\n'); end != std::string::npos; end = input.find('\n', start))
+        {
+            std::istringstream line(input.substr(start, end - start));
+            std::string status;
+            size_t id;
+            line >> status >> id;
+            //pipelined replies come back in the order of the requests
+            if(status != "OK" || id != acknowledged)
+            {
+                throw std::runtime_error("Unexpected reply from SMS gateway: " + line.str());
+            }
+            ++acknowledged;
+            start = end + 1;
+        }
+        input.erase(0, start);
+    }
+
+    const size_t queueLimit;
+    int fd = -1;
+    int epollFd = -1;
+    std::deque<std::string> outgoing;
+    size_t outgoingOffset = 0;
+    size_t queuedBytes = 0;
+    std::string input;
+    bool watchingWritable = false;
+    bool connected = true;
+    size_t nextId = 0;
+    size_t written = 0;
+    size_t acknowledged = 0;
+    size_t dropped = 0;
+};
+
+class SmsNotification : public NotificationChannel
+{
+public:
+    explicit SmsNotification(std::shared_ptr<SmsGatewayClient> gatewayClient) : client(std::move(gatewayClient)) {}
+
+    void notify(double value) override
+    {
+        client->send("Price changed to " + std::to_string(value));
+    }
+
+private:
+    std::shared_ptr<SmsGatewayClient> client;
+};
+
+//Local server with the gateway protocol, serving all connections from one epoll thread
+class StandInSmsGateway
+{
+public:
+    explicit StandInSmsGateway(std::string socketPath) : path(std::move(socketPath))
+    {
+        ::unlink(path.c_str());
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        const auto address = unixAddress(path);
+        if(listenFd < 0
+           || ::bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+           || ::listen(listenFd, 64) < 0)
+        {
+            const auto error = systemError("Can't listen on " + path);
+            if(listenFd >= 0)
+            {
+                ::close(listenFd);
+            }
+            throw error;
+        }
+        wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epollFd = wakeFd < 0 ? -1 : ::epoll_create1(EPOLL_CLOEXEC);
+        if(epollFd < 0)
+        {
+            const auto error = systemError("Can't set up epoll");
+            if(wakeFd >= 0)
+            {
+                ::close(wakeFd);
+            }
+            ::close(listenFd);
+            ::unlink(path.c_str());
+            throw error;
+        }
+        watch(listenFd, EPOLLIN);
+        watch(wakeFd, EPOLLIN);
+        thread = std::thread([this] { run(); });
+    }
+
+    ~StandInSmsGateway()
+    {
+        const std::uint64_t one = 1;
+        [[maybe_unused]] auto ignored = ::write(wakeFd, &one, sizeof(one));
+        thread.join();
+        for(auto& [fd, connection] : connections)
+        {
+            ::close(fd);
+        }
+        ::close(epollFd);
+        ::close(wakeFd);
+        ::close(listenFd);
+        ::unlink(path.c_str());
+    }
+
+    StandInSmsGateway(const StandInSmsGateway&) = delete;
+    StandInSmsGateway& operator=(const StandInSmsGateway&) = delete;
+
+    size_t getReceived() const { return received.load(); }
+
+private:
+    struct Connection
+    {
+        std::string input;
+        std::string output;
+        bool watchingWritable = false;
+    };
+
+    void watch(int fd, std::uint32_t events, int operation = EPOLL_CTL_ADD)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        ::epoll_ctl(epollFd, operation, fd, &event);
+    }
+
+    void run()
+    {
+        epoll_event events[64];
+        for(;;)
+        {
+            const int ready = ::epoll_wait(epollFd, events, 64, -1);
+            for(int i = 0; i < ready; ++i)
+            {
+                const int fd = events[i].data.fd;
+                if(fd == wakeFd)
+                {
+                    return;
+                }
+                if(fd == listenFd)
+                {
+                    accept();
+                    continue;
+                }
+                if(!serve(fd, connections[fd]))
+                {
+                    ::close(fd);
+                    connections.erase(fd);
+                }
+            }
+        }
+    }
+
+    void accept()
+    {
+        for(int fd; (fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0;)
+        {
+            connections[fd];
+            watch(fd, EPOLLIN);
+        }
+    }
+
+    //returns false when the connection is done
+    bool serve(int fd, Connection& connection)
+    {
+        char buffer[16384];
+        for(;;)
+        {
+            const auto bytes = ::read(fd, buffer, sizeof(buffer));
+            if(bytes == 0)
+            {
+                return false;
+            }
+            if(bytes < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                return false;
+            }
+            connection.input.append(buffer, bytes);
+        }
+
+        //all replies to one read go out together
+        size_t start = 0;
+        for(auto end = connection.input.find('\n'); end != std::string::npos; end = connection.input.find('\n', start))
+        {
+            const auto idStart = connection.input.find(' ', start) + 1;
+            const auto idEnd = connection.input.find(' ', idStart);
+            connection.output += "OK " + connection.input.substr(idStart, idEnd - idStart) + "\n";
+            ++received;
+            start = end + 1;
+        }
+        connection.input.erase(0, start);
+
+        while(!connection.output.empty())
+        {
+            const auto bytes = ::send(fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+            if(bytes < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                return false;
+            }
+            connection.output.erase(0, bytes);
+        }
+        const bool writable = !connection.output.empty();
+        if(writable != connection.watchingWritable)
+        {
+            watch(fd, writable ? EPOLLIN | EPOLLOUT : EPOLLIN, EPOLL_CTL_MOD);
+            connection.watchingWritable = writable;
+        }
+        return true;
+    }
+
+    const std::string path;
+    int listenFd = -1;
+    int wakeFd = -1;
+    int epollFd = -1;
+    std::thread thread;
+    std::map<int, Connection> connections;
+    std::atomic<size_t> received{0};
+};
+
+class Stock
+{
+private:
+    double value;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+public:
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer->notify(value);
+        }
+    }
+
+    void attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        observers.push_back(newObserver);
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+    }
+
+    void setValue(double newValue)
+    {
+        //just for test purposes
+        value = newValue;
+        valueChanged();
+    }
+};
+
+inline std::string testSocketPath(const std::string& name)
+{
+    return (std::filesystem::temp_directory_path() / (name + "." + std::to_string(::getpid()))).string();
+}
+
+TEST_CASE("SmsNotification through a non-blocking gateway client")
+{
+    StandInSmsGateway gateway(testSocketPath("sms_gateway_test"));
+    auto client = std::make_shared<SmsGatewayClient>(testSocketPath("sms_gateway_test"));
+
+    Stock motoStock;
+    motoStock.attach(std::make_shared<SmsNotification>(client));
+
+    const size_t ticks = 20000;
+    for(size_t i = 0; i < ticks; ++i)
+    {
+        motoStock.setValue(1.0 + i);
+        //the event loop gets its turn between ticks, but never waits
+        client->poll(0);
+    }
+    while(client->isConnected() && client->getAcknowledged() < ticks)
+    {
+        client->poll(100);
+    }
+
+    REQUIRE(client->isConnected());
+    CHECK(client->getDropped() == 0);
+    CHECK(client->getWritten() == ticks);
+    CHECK(client->inFlight() == 0);
+    CHECK(gateway.getReceived() == ticks);
+}
+
+TEST_CASE("Full queue drops messages instead of blocking the notifier")
+{
+    StandInSmsGateway gateway(testSocketPath("sms_gateway_full_test"));
+    SmsGatewayClient client(testSocketPath("sms_gateway_full_test"), 64);
+
+    //nobody polls, so nothing is read back, but the socket buffer takes the first requests
+    size_t accepted = 0;
+    for(int i = 0; i < 100000 && client.getDropped() == 0; ++i)
+    {
+        accepted += client.send(std::string(40, 'x'));
+    }
+
+    CHECK(client.getDropped() > 0);
+    while(client.isConnected() && client.getAcknowledged() < accepted)
+    {
+        client.poll(100);
+    }
+    REQUIRE(client.isConnected());
+    CHECK(gateway.getReceived() == accepted);
+}
+
+TEST_CASE("Gateway going away mid-session doesn't take the notifier down")
+{
+    auto gateway = std::make_unique<StandInSmsGateway>(testSocketPath("sms_gateway_gone_test"));
+    auto client = std::make_shared<SmsGatewayClient>(testSocketPath("sms_gateway_gone_test"));
+    Stock motoStock;
+    motoStock.attach(std::make_shared<SmsNotification>(client));
+
+    for(int i = 0; i < 100; ++i)
+    {
+        motoStock.setValue(i);
+    }
+    while(client->isConnected() && client->getAcknowledged() < 100)
+    {
+        client->poll(100);
+    }
+    REQUIRE(client->isConnected());
+
+    gateway.reset();
+    for(int i = 0; i < 100; ++i)
+    {
+        motoStock.setValue(i);
+        client->poll(0);
+    }
+
+    CHECK_FALSE(client->isConnected());
+    CHECK(client->getAcknowledged() == 100);
+    CHECK(client->getDropped() == 100);
+    CHECK(client->inFlight() == 0);
+}
+
+TEST_CASE("Benchmark: SMS gateway throughput" * doctest::skip())
+{
+    StandInSmsGateway gateway(testSocketPath("sms_gateway_benchmark"));
+    SmsGatewayClient client(testSocketPath("sms_gateway_benchmark"), 16 << 20);
+
+    const size_t messages = 1000000;
+    const auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < messages && client.isConnected(); ++i)
+    {
+        while(!client.send("Price changed to 123.45") && client.isConnected())
+        {
+            client.poll(1);
+        }
+        if(i % 256 == 0)
+        {
+            client.poll(0);
+        }
+    }
+    while(client.isConnected() && client.getAcknowledged() < messages)
+    {
+        client.poll(100);
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    REQUIRE(client.isConnected());
+
+    std::cout << "SMS gateway: " << messages / elapsed.count() << " messages/s\n";
+    CHECK(gateway.getReceived() == messages);
+}
+
+}
@@ -0,0 +1,397 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <thread>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+
+//Snapshot first, then deltas
+//
+//A channel attached mid-session (or one reconnecting after a failure) needs the current price
+//of every symbol, not just the next tick. A Subscription first hands its channel a Snapshot of
+//the whole MarketBook, taken at a single version, and then every update after that version -
+//no update is missed and none is delivered twice.
+//
+//The tick path doesn't know about late joiners at all. For every update it
+//- writes the symbol's entry (value + version) under a per-entry seqlock
+//- appends the update to a broadcast ring of recent updates
+//A Subscription copies the entries without locking anything. The copy isn't a consistent cut,
+//because ticks keep coming while it's taken, so it's rolled forward: the updates the copy may
+//have missed are all in the ring, and applying them makes it consistent at the highest version
+//seen. The subscription then follows the ring. If it falls a whole ring behind, it takes a new
+//snapshot instead.
+
+namespace SnapshotObserver {
+
+using SymbolId = std::uint32_t;
+
+//versions count the updates of a book, the first update has version 1
+struct Delta
+{
+    std::uint64_t version;
+    SymbolId symbol;
+    double value;
+};
+
+struct Snapshot
+{
+    std::uint64_t version = 0;          //state after this many updates
+    std::vector<double> values;         //indexed by SymbolId
+};
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notifySnapshot(const Snapshot& snapshot) = 0;
+    virtual void notify(const Delta& delta) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notifySnapshot(const Snapshot& snapshot) override
+    {
+        std::cout << "Redrawing LcdScreen with " << snapshot.values.size() << " prices\n";
+    }
+
+    void notify(const Delta& delta) override
+    {
+        std::cout << "Updating LcdScreen\n";
+    }
+};
+
+class Subscription;
+
+class MarketBook
+{
+public:
+    //all symbols start at 0.0; ringCapacity must be a power of two
+    explicit MarketBook(size_t symbolCount, std::uint64_t ringCapacity = 1 << 16)
+        : symbols(symbolCount), entries(new Entry[symbolCount]), capacity(ringCapacity), ring(new Slot[ringCapacity])
+    {
+        if(!std::has_single_bit(ringCapacity))
+        {
+            throw std::invalid_argument("Ring capacity must be a power of two");
+        }
+    }
+
+    //tick path, single writer
+    void setValue(SymbolId symbol, double newValue)
+    {
+        if(symbol >= symbols)
+        {
+            throw std::out_of_range("Unknown symbol id " + std::to_string(symbol));
+        }
+        const auto version = ++last;
+        const auto bits = std::bit_cast<std::uint64_t>(newValue);
+
+        //entry first: an update a snapshot copy doesn't see is then surely still to come in the ring
+        auto& entry = entries[symbol];
+        const auto sequence = entry.sequence.load(std::memory_order_relaxed);
+        entry.sequence.store(sequence + 1, std::memory_order_relaxed);
+        entry.value.store(bits, std::memory_order_release);
+        entry.version.store(version, std::memory_order_release);
+        entry.sequence.store(sequence + 2, std::memory_order_release);
+
+        auto& slot = ring[(version - 1) & (capacity - 1)];
+        slot.sequence.store(2 * version - 1, std::memory_order_relaxed);
+        slot.symbol.store(symbol, std::memory_order_release);
+        slot.value.store(bits, std::memory_order_release);
+        slot.sequence.store(2 * version, std::memory_order_release);
+
+        published.store(version, std::memory_order_release);
+    }
+
+    //any thread
+    double value(SymbolId symbol) const
+    {
+        double result;
+        std::uint64_t version;
+        read(symbol, result, version);
+        return result;
+    }
+
+    std::uint64_t version() const { return published.load(std::memory_order_acquire); }
+    size_t size() const { return symbols; }
+
+private:
+    friend class Subscription;
+
+    struct alignas(64) Entry
+    {
+        std::atomic<std::uint64_t> sequence{0};
+        std::atomic<std::uint64_t> value{0};
+        std::atomic<std::uint64_t> version{0};
+    };
+
+    struct alignas(32) Slot
+    {
+        std::atomic<std::uint64_t> sequence{0};
+        std::atomic<std::uint64_t> symbol{0};
+        std::atomic<std::uint64_t> value{0};
+    };
+
+    void read(SymbolId symbol, double& value, std::uint64_t& version) const
+    {
+        const auto& entry = entries[symbol];
+        for(;;)
+        {
+            const auto before = entry.sequence.load(std::memory_order_acquire);
+            const auto bits = entry.value.load(std::memory_order_acquire);
+            version = entry.version.load(std::memory_order_acquire);
+            if(before % 2 == 0 && entry.sequence.load(std::memory_order_relaxed) == before)
+            {
+                value = std::bit_cast<double>(bits);
+                return;
+            }
+        }
+    }
+
+    //false if the update has already been overwritten in the ring
+    bool read(std::uint64_t version, Delta& delta) const
+    {
+        const auto& slot = ring[(version - 1) & (capacity - 1)];
+        const auto before = slot.sequence.load(std::memory_order_acquire);
+        const auto symbol = slot.symbol.load(std::memory_order_acquire);
+        const auto bits = slot.value.load(std::memory_order_acquire);
+        if(before != 2 * version || slot.sequence.load(std::memory_order_relaxed) != before)
+        {
+            return false;
+        }
+        delta = {version, static_cast<SymbolId>(symbol), std::bit_cast<double>(bits)};
+        return true;
+    }
+
+    const size_t symbols;
+    std::unique_ptr<Entry[]> entries;
+    const std::uint64_t capacity;
+    std::unique_ptr<Slot[]> ring;
+    std::uint64_t last = 0;
+    alignas(64) std::atomic<std::uint64_t> published{0};
+};
+
+//Delivers the book to one channel, driven by poll() from the channel's own thread
+class Subscription
+{
+public:
+    Subscription(const MarketBook& marketBook, std::shared_ptr<NotificationChannel> subscriber)
+        : book(marketBook), channel(std::move(subscriber)) {}
+
+    //snapshot on the first call, then all updates published since, returns how many deltas there were
+    size_t poll()
+    {
+        if(!next)
+        {
+            resync();
+        }
+        size_t delivered = 0;
+        for(Delta delta; next <= book.version(); ++next)
+        {
+            if(!book.read(next, delta))
+            {
+                resync();
+                --next;
+                continue;
+            }
+            channel->notify(delta);
+            ++delivered;
+        }
+        return delivered;
+    }
+
+    size_t getSnapshots() const { return snapshots; }
+
+private:
+    void resync()
+    {
+        Snapshot snapshot;
+        std::vector<std::uint64_t> versions(book.size());
+        snapshot.values.resize(book.size());
+        for(;;)
+        {
+            const auto start = book.version();
+            snapshot.version = start;
+            for(SymbolId symbol = 0; symbol < book.size(); ++symbol)
+            {
+                book.read(symbol, snapshot.values[symbol], versions[symbol]);
+                snapshot.version = std::max(snapshot.version, versions[symbol]);
+            }
+            //the newest entry may be copied just before its update reaches the ring
+            while(book.version() < snapshot.version)
+            {
+                std::this_thread::yield();
+            }
+            if(rollForward(snapshot, versions, start))
+            {
+                break;
+            }
+        }
+        channel->notifySnapshot(snapshot);
+        next = snapshot.version + 1;
+        ++snapshots;
+    }
+
+    //applies the updates after start which the copy may have missed
+    bool rollForward(Snapshot& snapshot, std::vector<std::uint64_t>& versions, std::uint64_t start) const
+    {
+        Delta delta;
+        for(auto version = start + 1; version <= snapshot.version; ++version)
+        {
+            if(!book.read(version, delta))
+            {
+                return false;
+            }
+            if(delta.version > versions[delta.symbol])
+            {
+                snapshot.values[delta.symbol] = delta.value;
+                versions[delta.symbol] = delta.version;
+            }
+        }
+        return true;
+    }
+
+    const MarketBook& book;
+    std::shared_ptr<NotificationChannel> channel;
+    std::uint64_t next = 0;
+    size_t snapshots = 0;
+};
+
+//channel keeping its own copy of the book, checking that deltas continue the snapshot
+class MirrorChannel : public NotificationChannel
+{
+public:
+    void notifySnapshot(const Snapshot& snapshot) override
+    {
+        values = snapshot.values;
+        version = snapshot.version;
+    }
+
+    void notify(const Delta& delta) override
+    {
+        contiguous = contiguous && delta.version == version + 1;
+        version = delta.version;
+        values[delta.symbol] = delta.value;
+    }
+
+    std::vector<double> values;
+    std::uint64_t version = 0;
+    bool contiguous = true;
+};
+
+TEST_CASE("Late joiner gets the current prices first")
+{
+    MarketBook book(3);
+    auto lcd = std::make_shared<LcdScreen>();
+    book.setValue(0, 1.0);
+    book.setValue(2, 5.1);
+
+    Subscription lateLcd(book, lcd);
+    lateLcd.poll();
+    book.setValue(1, 2.0);
+    lateLcd.poll();
+}
+
+TEST_CASE("Snapshot is followed by the deltas after its version")
+{
+    MarketBook book(3);
+    book.setValue(0, 1.0);
+    book.setValue(2, 5.1);
+    book.setValue(0, 1.5);
+
+    auto mirror = std::make_shared<MirrorChannel>();
+    Subscription subscription(book, mirror);
+    CHECK(subscription.poll() == 0);
+    CHECK(mirror->version == 3);
+    CHECK(mirror->values == std::vector<double>{1.5, 0.0, 5.1});
+
+    book.setValue(1, 2.0);
+    book.setValue(0, 1.4);
+    CHECK(subscription.poll() == 2);
+    CHECK(mirror->version == 5);
+    CHECK(mirror->contiguous);
+    CHECK(mirror->values == std::vector<double>{1.4, 2.0, 5.1});
+    CHECK(subscription.getSnapshots() == 1);
+}
+
+TEST_CASE("Subscription which fell a whole ring behind starts over with a new snapshot")
+{
+    MarketBook book(4, 8);
+    auto mirror = std::make_shared<MirrorChannel>();
+    Subscription subscription(book, mirror);
+    subscription.poll();
+
+    for(int i = 1; i <= 20; ++i)
+    {
+        book.setValue(i % 4, i);
+    }
+    subscription.poll();
+
+    CHECK(subscription.getSnapshots() == 2);
+    CHECK(mirror->version == 20);
+    CHECK(mirror->values == std::vector<double>{20, 17, 18, 19});
+}
+
+TEST_CASE("Subscriptions joining while ticks flow see every update exactly once")
+{
+    const size_t symbols = 2000;
+    const std::uint64_t updates = 500000;
+    MarketBook book(symbols);
+
+    std::atomic<bool> done{false};
+    std::thread feed([&]
+    {
+        for(std::uint64_t i = 1; i <= updates; ++i)
+        {
+            book.setValue((i * 7919) % symbols, static_cast<double>(i));
+        }
+        done = true;
+    });
+
+    //join at different points of the session
+    std::vector<std::thread> joiners;
+    std::vector<std::shared_ptr<MirrorChannel>> mirrors;
+    for(int j = 0; j < 3; ++j)
+    {
+        mirrors.push_back(std::make_shared<MirrorChannel>());
+        joiners.emplace_back([&book, &done, mirror = mirrors.back(), j]
+        {
+            while(book.version() < j * updates / 4 && !done)
+            {
+                std::this_thread::yield();
+            }
+            Subscription subscription(book, mirror);
+            while(!done)
+            {
+                subscription.poll();
+            }
+            subscription.poll();
+        });
+    }
+
+    feed.join();
+    for(auto& joiner : joiners)
+    {
+        joiner.join();
+    }
+
+    std::vector<double> expected(symbols);
+    for(SymbolId symbol = 0; symbol < symbols; ++symbol)
+    {
+        expected[symbol] = book.value(symbol);
+    }
+    for(const auto& mirror : mirrors)
+    {
+        CHECK(mirror->version == updates);
+        CHECK(mirror->contiguous);
+        CHECK(mirror->values == expected);
+    }
+}
+
+}
@@ -0,0 +1,55 @@
+#include "doctest.h"
+#include "TickGenerator.h"
+
+namespace LoadTesting {
+
+TEST_CASE("Tick generator is reproducible")
+{
+    TickGenerator first(42), second(42), other(43);
+    bool differs = false;
+    for(int i = 0; i < 1000; ++i)
+    {
+        const auto a = first.next();
+        const auto b = second.next();
+        const auto c = other.next();
+        REQUIRE(a.symbol == b.symbol);
+        REQUIRE(a.value == b.value);
+        REQUIRE(a.timestamp == b.timestamp);
+        differs = differs || a.symbol != c.symbol || a.value != c.value;
+    }
+    CHECK(differs);
+}
+
+TEST_CASE("Generated market has popular symbols, random walks and bursts")
+{
+    TickProfile profile;
+    profile.symbols = 500;
+    TickGenerator generator(7, profile);
+
+    std::vector<size_t> counts(profile.symbols);
+    size_t burstTicks = 0;
+    std::uint64_t lastTimestamp = 0;
+    bool positive = true;
+    bool monotonic = true;
+    const size_t ticks = 200000;
+    for(size_t i = 0; i < ticks; ++i)
+    {
+        const auto tick = generator.next();
+        ++counts[tick.symbol];
+        burstTicks += tick.burst;
+        positive = positive && tick.value > 0.0;
+        monotonic = monotonic && tick.timestamp >= lastTimestamp;
+        lastTimestamp = tick.timestamp;
+    }
+
+    CHECK(counts[0] > counts[1]);
+    CHECK(counts[1] > counts[10]);
+    CHECK(counts[10] > counts[400]);
+    CHECK(counts[0] > ticks / 10);
+    CHECK(positive);
+    CHECK(monotonic);
+    CHECK(burstTicks > 0);
+    CHECK(burstTicks < ticks / 2);
+}
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+//Generated market data for load testing
+//
+//TickGenerator produces a reproducible market: for a given seed always the same ticks on the same
+//platform. std::mt19937_64 is specified exactly and the standard distributions aren't, so only the
+//engine is used; std::pow and std::log1p may still round differently in another math library.
+//- symbols are picked with Zipfian popularity - a few symbols get most of the ticks
+//- each price follows a random walk
+//- ticks arrive at exponentially distributed intervals, now and then a burst brings a much
+//  higher rate and bigger price moves for a while
+
+namespace LoadTesting {
+
+struct GeneratedTick
+{
+    std::uint32_t symbol;
+    double value;
+    std::uint64_t timestamp;    //nanoseconds since the first tick
+    bool burst;
+};
+
+struct TickProfile
+{
+    size_t symbols = 1000;
+    double zipfExponent = 1.1;
+    double volatility = 0.001;          //biggest relative price change of a tick
+    double ticksPerSecond = 100000;     //outside bursts
+    double burstProbability = 0.0005;   //chance that a tick starts a burst
+    size_t burstLength = 500;           //ticks
+    double burstIntensity = 20;         //rate and volatility multiplier during a burst
+};
+
+class TickGenerator
+{
+public:
+    explicit TickGenerator(std::uint64_t seed, TickProfile tickProfile = {})
+        : profile(tickProfile), rng(seed), popularity(tickProfile.symbols), prices(tickProfile.symbols)
+    {
+        if(!profile.symbols || profile.volatility * profile.burstIntensity >= 1.0)
+        {
+            throw std::invalid_argument("Tick profile would produce no symbols or non-positive prices");
+        }
+        double cumulative = 0.0;
+        for(size_t rank = 0; rank < profile.symbols; ++rank)
+        {
+            cumulative += 1.0 / std::pow(rank + 1.0, profile.zipfExponent);
+            popularity[rank] = cumulative;
+            prices[rank] = 10.0 + 90.0 * uniform();
+        }
+    }
+
+    GeneratedTick next()
+    {
+        if(burstLeft)
+        {
+            --burstLeft;
+        }
+        else if(uniform() < profile.burstProbability)
+        {
+            burstLeft = profile.burstLength;
+        }
+        const bool burst = burstLeft > 0;
+        const double intensity = burst ? profile.burstIntensity : 1.0;
+
+        const auto rank = std::upper_bound(popularity.begin(), popularity.end(), uniform() * popularity.back())
+                          - popularity.begin();
+        const auto symbol = static_cast<std::uint32_t>(std::min<size_t>(rank, profile.symbols - 1));
+        prices[symbol] *= 1.0 + profile.volatility * intensity * (2.0 * uniform() - 1.0);
+        time += static_cast<std::uint64_t>(-std::log1p(-uniform()) * 1e9 / (profile.ticksPerSecond * intensity));
+
+        return {symbol, prices[symbol], time, burst};
+    }
+
+private:
+    //[0, 1) with 53 random bits
+    double uniform()
+    {
+        return static_cast<double>(rng() >> 11) * 0x1.0p-53;
+    }
+
+    const TickProfile profile;
+    std::mt19937_64 rng;
+    std::vector<double> popularity;     //cumulative, by symbol
+    std::vector<double> prices;
+    std::uint64_t time = 0;
+    size_t burstLeft = 0;
+};
+
+}
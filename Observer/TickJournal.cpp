@@ -0,0 +1,405 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//Recording and replaying a trading day
+//
+//JournalChannel is an ordinary NotificationChannel - attached to a Stock it appends every price
+//change as a fixed-size binary record (timestamp, symbol, value) to a journal file. Records are
+//collected in memory and written in batches, not one write() per tick.
+//
+//JournalReplayer maps the journal into memory and drives the Stocks - and through them the very
+//same observers as in production - either as fast as possible or with the original timing.
+
+namespace TickJournal {
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Updating LcdScreen\n";
+    }
+};
+
+class Stock
+{
+private:
+    double value = 0.0;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+public:
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer->notify(value);
+        }
+    }
+
+    void attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        observers.push_back(newObserver);
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+    }
+
+    void setValue(double newValue)
+    {
+        value = newValue;
+        valueChanged();
+    }
+
+    double getValue() const { return value; }
+};
+
+struct JournalHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+};
+
+struct JournalRecord
+{
+    std::int64_t timestamp;     //nanoseconds since epoch
+    std::uint32_t symbol;
+    std::uint32_t reserved;
+    double value;
+};
+
+static_assert(sizeof(JournalHeader) == 16, "Journal layout must not depend on the compiler");
+static_assert(sizeof(JournalRecord) == 24, "Journal layout must not depend on the compiler");
+
+constexpr char journalMagic[8] = {'T', 'I', 'C', 'K', 'J', 'R', 'N', 'L'};
+constexpr std::uint32_t journalVersion = 1;
+
+//reads errno, so it must be built before anything else (even close) can change it
+inline std::runtime_error systemError(const std::string& what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+//Closes the file descriptor when it goes out of scope
+class FileDescriptor
+{
+public:
+    explicit FileDescriptor(int descriptor) : fd(descriptor) {}
+
+    ~FileDescriptor()
+    {
+        if(fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd; }
+
+private:
+    const int fd;
+};
+
+class JournalWriter
+{
+public:
+    explicit JournalWriter(const std::string& path, size_t batchSize = 4096)
+        : fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644))
+    {
+        if(fd.get() < 0)
+        {
+            throw systemError("Can't create journal " + path);
+        }
+        JournalHeader header{};
+        std::memcpy(header.magic, journalMagic, sizeof(journalMagic));
+        header.version = journalVersion;
+        header.recordSize = sizeof(JournalRecord);
+        writeAll(&header, sizeof(header));
+        buffer.reserve(batchSize);
+    }
+
+    ~JournalWriter()
+    {
+        try
+        {
+            flush();
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+        }
+    }
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    void append(const JournalRecord& record)
+    {
+        buffer.push_back(record);
+        if(buffer.size() == buffer.capacity())
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        writeAll(buffer.data(), buffer.size() * sizeof(JournalRecord));
+        buffer.clear();
+    }
+
+private:
+    void writeAll(const void* data, size_t size)
+    {
+        auto bytes = static_cast<const char*>(data);
+        while(size)
+        {
+            const auto written = ::write(fd.get(), bytes, size);
+            if(written < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                throw systemError("Can't write journal");
+            }
+            bytes += written;
+            size -= written;
+        }
+    }
+
+    FileDescriptor fd;
+    std::vector<JournalRecord> buffer;
+};
+
+//One per journaled Stock, all of them may share one JournalWriter
+class JournalChannel : public NotificationChannel
+{
+public:
+    JournalChannel(std::shared_ptr<JournalWriter> theWriter, std::uint32_t theSymbol)
+        : writer(std::move(theWriter)), symbol(theSymbol) {}
+
+    void notify(double value) override
+    {
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        writer->append({std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), symbol, 0, value});
+    }
+
+private:
+    std::shared_ptr<JournalWriter> writer;
+    const std::uint32_t symbol;
+};
+
+class JournalReplayer
+{
+public:
+    enum class Speed
+    {
+        Maximum,
+        Original
+    };
+
+    explicit JournalReplayer(const std::string& path)
+    {
+        const FileDescriptor fd(::open(path.c_str(), O_RDONLY));
+        if(fd.get() < 0)
+        {
+            throw systemError("Can't open journal " + path);
+        }
+        struct stat info;
+        if(::fstat(fd.get(), &info) < 0)
+        {
+            throw systemError("Can't stat journal " + path);
+        }
+        size = info.st_size;
+        if(size < sizeof(JournalHeader))
+        {
+            throw std::runtime_error("Journal " + path + " is truncated");
+        }
+        //the mapping stays valid after fd is closed
+        data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+        if(data == MAP_FAILED)
+        {
+            throw systemError("Can't map journal " + path);
+        }
+        ::madvise(data, size, MADV_SEQUENTIAL);
+
+        const auto header = static_cast<const JournalHeader*>(data);
+        if(std::memcmp(header->magic, journalMagic, sizeof(journalMagic)) != 0
+           || header->version != journalVersion || header->recordSize != sizeof(JournalRecord))
+        {
+            ::munmap(data, size);
+            throw std::runtime_error("Journal " + path + " has an unknown format");
+        }
+    }
+
+    ~JournalReplayer()
+    {
+        ::munmap(data, size);
+    }
+
+    JournalReplayer(const JournalReplayer&) = delete;
+    JournalReplayer& operator=(const JournalReplayer&) = delete;
+
+    //a record which hasn't been written completely is ignored
+    size_t recordCount() const { return (size - sizeof(JournalHeader)) / sizeof(JournalRecord); }
+
+    const JournalRecord* records() const
+    {
+        return reinterpret_cast<const JournalRecord*>(static_cast<const char*>(data) + sizeof(JournalHeader));
+    }
+
+    //stocks are indexed by symbol, ticks of symbols without a Stock are skipped
+    void replay(const std::vector<Stock*>& stocks, Speed speed = Speed::Maximum) const
+    {
+        const auto count = recordCount();
+        if(!count)
+        {
+            return;
+        }
+        const auto begin = records();
+        const auto start = std::chrono::steady_clock::now();
+        for(auto record = begin; record != begin + count; ++record)
+        {
+            if(speed == Speed::Original)
+            {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(record->timestamp - begin->timestamp));
+            }
+            if(record->symbol < stocks.size() && stocks[record->symbol])
+            {
+                stocks[record->symbol]->setValue(record->value);
+            }
+        }
+    }
+
+private:
+    void* data;
+    size_t size;
+};
+
+class RecordingChannel : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        values.push_back(value);
+    }
+    std::vector<double> values;
+};
+
+TEST_CASE("Recorded ticks are replayed through the same observers")
+{
+    const auto path = (std::filesystem::temp_directory_path() / "observer_journal_test.bin").string();
+
+    std::vector<double> original;
+    {
+        auto writer = std::make_shared<JournalWriter>(path, 64);
+        Stock moto, nokia;
+        moto.attach(std::make_shared<JournalChannel>(writer, 0));
+        nokia.attach(std::make_shared<JournalChannel>(writer, 1));
+        for(int i = 0; i < 1000; ++i)
+        {
+            moto.setValue(i * 0.5);
+            original.push_back(i * 0.5);
+            if(i % 3 == 0)
+            {
+                nokia.setValue(-i);
+            }
+        }
+    }
+
+    JournalReplayer replayer(path);
+    CHECK(replayer.recordCount() == 1000 + 334);
+
+    Stock moto, nokia;
+    auto recorder = std::make_shared<RecordingChannel>();
+    moto.attach(recorder);
+    replayer.replay({&moto, &nokia});
+
+    CHECK(recorder->values == original);
+    CHECK(nokia.getValue() == -999.0);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Replay at original timing keeps the gaps between ticks")
+{
+    const auto path = (std::filesystem::temp_directory_path() / "observer_journal_timing_test.bin").string();
+    {
+        JournalWriter writer(path);
+        const std::int64_t ms = 1000000;
+        writer.append({0, 0, 0, 1.0});
+        writer.append({20 * ms, 0, 0, 2.0});
+        writer.append({40 * ms, 0, 0, 3.0});
+    }
+
+    JournalReplayer replayer(path);
+    Stock stock;
+    const auto start = std::chrono::steady_clock::now();
+    replayer.replay({&stock}, JournalReplayer::Speed::Original);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    CHECK(stock.getValue() == 3.0);
+    CHECK(elapsed >= std::chrono::milliseconds(40));
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Missing journal is reported with the reason")
+{
+    const auto path = (std::filesystem::temp_directory_path() / "observer_journal_missing_test.bin").string();
+    std::filesystem::remove(path);
+    try
+    {
+        JournalReplayer replayer(path);
+        FAIL("Missing journal was opened");
+    }
+    catch(const std::runtime_error& e)
+    {
+        CHECK(std::string(e.what()).find(std::strerror(ENOENT)) != std::string::npos);
+    }
+}
+
+TEST_CASE("Journal with a foreign format is rejected")
+{
+    const auto path = (std::filesystem::temp_directory_path() / "observer_journal_bad_test.bin").string();
+    {
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        REQUIRE(fd >= 0);
+        const char garbage[32] = "definitely not a tick journal";
+        CHECK(::write(fd, garbage, sizeof(garbage)) == sizeof(garbage));
+        ::close(fd);
+    }
+
+    CHECK_THROWS_AS(JournalReplayer{path}, const std::runtime_error&);
+
+    std::filesystem::remove(path);
+}
+
+}
@@ -0,0 +1,333 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <array>
+#include <cstdint>
+
+//Feeding Stock from other threads
+//
+//Stock::setValue() used to be called by whoever had a new price. Here the feed handler
+//(parsing the market data, typically pinned to its own core) only pushes Ticks into a ring
+//buffer. The dispatch thread takes them out in batches and calls setValue(), so parsing and
+//fan-out to the NotificationChannels run on separate cores and never take a lock.
+//
+//SpscRing - one feed thread, one dispatch thread
+//MpscRing - several feed threads, one dispatch thread
+
+namespace TickIngestion {
+
+//Observer
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(double value) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        std::cout << "Updating LcdScreen\n";
+    }
+};
+
+class Stock
+{
+private:
+    double value = 0.0;
+    std::vector<std::shared_ptr<NotificationChannel>> observers;
+public:
+    void valueChanged()
+    {
+        for(auto& observer : observers)
+        {
+            observer->notify(value);
+        }
+    }
+
+    void attach(std::shared_ptr<NotificationChannel> newObserver)
+    {
+        observers.push_back(newObserver);
+    }
+    void detach(std::shared_ptr<NotificationChannel> observer)
+    {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+    }
+
+    void setValue(double newValue)
+    {
+        value = newValue;
+        valueChanged();
+    }
+};
+
+struct Tick
+{
+    std::uint32_t symbol;
+    double value;
+};
+
+constexpr size_t cacheLine = 64;
+
+//Single producer / single consumer ring.
+//Producer and consumer indexes live on separate cache lines. Each side also keeps a private
+//copy of the other side's index and re-reads the shared one only when the copy says the ring
+//is full (or empty), so in the common case no cache line bounces between the cores.
+template<typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+    bool tryPush(const T& item)
+    {
+        const auto t = producer.tail.load(std::memory_order_relaxed);
+        if(t - producer.cachedHead == Capacity)
+        {
+            producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+            if(t - producer.cachedHead == Capacity)
+            {
+                return false;
+            }
+        }
+        slots[t & (Capacity - 1)] = item;
+        producer.tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    //takes up to maxCount items, publishes the new head once for the whole batch
+    size_t popBatch(T* out, size_t maxCount)
+    {
+        const auto h = consumer.head.load(std::memory_order_relaxed);
+        if(consumer.cachedTail == h)
+        {
+            consumer.cachedTail = producer.tail.load(std::memory_order_acquire);
+        }
+        const auto count = std::min<size_t>(consumer.cachedTail - h, maxCount);
+        for(size_t i = 0; i < count; ++i)
+        {
+            out[i] = slots[(h + i) & (Capacity - 1)];
+        }
+        if(count)
+        {
+            consumer.head.store(h + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+private:
+    struct alignas(cacheLine) ProducerSide
+    {
+        std::atomic<size_t> tail{0};
+        size_t cachedHead = 0;
+    };
+    struct alignas(cacheLine) ConsumerSide
+    {
+        std::atomic<size_t> head{0};
+        size_t cachedTail = 0;
+    };
+
+    ProducerSide producer;
+    ConsumerSide consumer;
+    alignas(cacheLine) std::array<T, Capacity> slots;
+};
+
+//Multi producer / single consumer ring.
+//Every slot carries a sequence number telling whether it is free for the producer of a given
+//round or filled for the consumer, producers claim slots with CAS on the shared tail.
+template<typename T, size_t Capacity>
+class MpscRing
+{
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+    MpscRing()
+    {
+        for(size_t i = 0; i < Capacity; ++i)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(const T& item)
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            auto& slot = slots[t & (Capacity - 1)];
+            const auto sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(t);
+            if(diff == 0)
+            {
+                if(tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed))
+                {
+                    slot.item = item;
+                    slot.sequence.store(t + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                t = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //stops at the first slot which is claimed but not written yet, so the order is preserved
+    size_t popBatch(T* out, size_t maxCount)
+    {
+        size_t count = 0;
+        while(count < maxCount)
+        {
+            auto& slot = slots[head & (Capacity - 1)];
+            if(slot.sequence.load(std::memory_order_acquire) != head + 1)
+            {
+                break;
+            }
+            out[count++] = slot.item;
+            slot.sequence.store(head + Capacity, std::memory_order_release);
+            ++head;
+        }
+        return count;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    alignas(cacheLine) std::atomic<size_t> tail{0};
+    alignas(cacheLine) size_t head = 0;
+    alignas(cacheLine) std::array<Slot, Capacity> slots;
+};
+
+//Runs on the dispatch thread - moves ticks from the ring into the Stocks
+template<typename Ring>
+class TickDispatcher
+{
+public:
+    TickDispatcher(Ring& theRing, std::vector<Stock>& theStocks) : ring(theRing), stocks(theStocks) {}
+
+    //returns the number of ticks dispatched
+    size_t poll()
+    {
+        const auto count = ring.popBatch(batch.data(), batch.size());
+        for(size_t i = 0; i < count; ++i)
+        {
+            stocks[batch[i].symbol].setValue(batch[i].value);
+        }
+        return count;
+    }
+
+private:
+    Ring& ring;
+    std::vector<Stock>& stocks;
+    std::array<Tick, 256> batch;
+};
+
+class SequenceCheckingChannel : public NotificationChannel
+{
+public:
+    void notify(double value) override
+    {
+        inOrder = inOrder && value > last;
+        last = value;
+        ++count;
+    }
+    double last = 0.0;
+    size_t count = 0;
+    bool inOrder = true;
+};
+
+TEST_CASE("Feed thread pushes ticks, dispatch thread notifies observers")
+{
+    const size_t tickCount = 200000;
+    SpscRing<Tick, 1024> ring;
+    std::vector<Stock> stocks(2);
+    auto channels = std::vector<std::shared_ptr<SequenceCheckingChannel>>{
+        std::make_shared<SequenceCheckingChannel>(), std::make_shared<SequenceCheckingChannel>()};
+    stocks[0].attach(channels[0]);
+    stocks[1].attach(channels[1]);
+
+    std::thread feed([&ring, tickCount] {
+        for(size_t i = 1; i <= tickCount; ++i)
+        {
+            const Tick tick{std::uint32_t(i % 2), double(i)};
+            while(!ring.tryPush(tick))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    TickDispatcher<SpscRing<Tick, 1024>> dispatcher(ring, stocks);
+    size_t dispatched = 0;
+    while(dispatched < tickCount)
+    {
+        dispatched += dispatcher.poll();
+    }
+    feed.join();
+
+    CHECK(channels[0]->count + channels[1]->count == tickCount);
+    CHECK(channels[0]->inOrder);
+    CHECK(channels[1]->inOrder);
+    CHECK(channels[0]->last == double(tickCount));
+}
+
+TEST_CASE("Several feed threads share one dispatch thread")
+{
+    const size_t feeds = 4;
+    const size_t ticksPerFeed = 50000;
+    MpscRing<Tick, 1024> ring;
+    std::vector<Stock> stocks(feeds);
+    std::vector<std::shared_ptr<SequenceCheckingChannel>> channels;
+    for(auto& stock : stocks)
+    {
+        channels.push_back(std::make_shared<SequenceCheckingChannel>());
+        stock.attach(channels.back());
+    }
+
+    std::vector<std::thread> producers;
+    for(std::uint32_t feed = 0; feed < feeds; ++feed)
+    {
+        producers.emplace_back([&ring, feed, ticksPerFeed] {
+            for(size_t i = 1; i <= ticksPerFeed; ++i)
+            {
+                while(!ring.tryPush(Tick{feed, double(i)}))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    TickDispatcher<MpscRing<Tick, 1024>> dispatcher(ring, stocks);
+    size_t dispatched = 0;
+    while(dispatched < feeds * ticksPerFeed)
+    {
+        dispatched += dispatcher.poll();
+    }
+    for(auto& producer : producers)
+    {
+        producer.join();
+    }
+
+    for(auto& channel : channels)
+    {
+        CHECK(channel->count == ticksPerFeed);
+        CHECK(channel->inOrder);
+    }
+}
+
+}
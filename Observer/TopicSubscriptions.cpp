@@ -0,0 +1,364 @@
+#include "doctest.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+#include <stdexcept>
+
+//Subscribing to topics instead of stocks
+//
+//Every stock has a hierarchical topic name, e.g. "EQ.US.MOTO". A channel subscribes to a
+//pattern instead of attaching to stocks one by one:
+//- "EQ.US.MOTO" - just that stock
+//- "EQ.*.MOTO"  - * matches exactly one level
+//- "EQ.US.#"    - # (only as the last level) matches any number of further levels, at least one
+//
+//Patterns are kept in a trie with one level per node. Walking it for every tick would be too
+//slow, so the channels a symbol resolves to are cached per symbol; any (un)subscription bumps
+//a generation number, and the next tick of each symbol resolves it again. After warm-up a tick
+//costs an array lookup and a generation check.
+
+namespace TopicObserver {
+
+using SymbolId = std::uint32_t;
+
+class NotificationChannel
+{
+public:
+    virtual ~NotificationChannel() = default;
+    virtual void notify(std::string_view topic, double value) = 0;
+};
+
+class LcdScreen : public NotificationChannel
+{
+public:
+    void notify(std::string_view topic, double value) override
+    {
+        std::cout << "Updating LcdScreen with " << topic << "\n";
+    }
+};
+
+class SmsNotification : public NotificationChannel
+{
+public:
+    void notify(std::string_view topic, double value) override
+    {
+        std::cout << "Sending SmsNotification about " << topic << "\n";
+    }
+};
+
+inline std::vector<std::string> splitTopic(std::string_view topic)
+{
+    std::vector<std::string> levels;
+    size_t start = 0;
+    for(;;)
+    {
+        const auto end = topic.find('.', start);
+        levels.emplace_back(topic.substr(start, end - start));
+        if(levels.back().empty())
+        {
+            throw std::invalid_argument("Empty level in topic " + std::string(topic));
+        }
+        if(end == std::string_view::npos)
+        {
+            return levels;
+        }
+        start = end + 1;
+    }
+}
+
+class TopicTrie
+{
+public:
+    void subscribe(std::string_view pattern, std::shared_ptr<NotificationChannel> channel)
+    {
+        auto levels = splitTopic(pattern);
+        Node* node = &root;
+        for(size_t i = 0; i < levels.size(); ++i)
+        {
+            if(levels[i] == "#")
+            {
+                if(i + 1 != levels.size())
+                {
+                    throw std::invalid_argument("# must be the last level of " + std::string(pattern));
+                }
+                node->subtree.push_back(std::move(channel));
+                return;
+            }
+            auto& child = node->children[levels[i]];
+            if(!child)
+            {
+                child = std::make_unique<Node>();
+            }
+            node = child.get();
+        }
+        node->exact.push_back(std::move(channel));
+    }
+
+    //false if the channel wasn't subscribed to the pattern
+    bool unsubscribe(std::string_view pattern, const std::shared_ptr<NotificationChannel>& channel)
+    {
+        auto levels = splitTopic(pattern);
+        const bool subtree = levels.back() == "#";
+        if(subtree)
+        {
+            levels.pop_back();
+        }
+        Node* node = &root;
+        for(const auto& level : levels)
+        {
+            auto child = node->children.find(level);
+            if(child == node->children.end())
+            {
+                return false;
+            }
+            node = child->second.get();
+        }
+        auto& channels = subtree ? node->subtree : node->exact;
+        auto found = std::find(channels.begin(), channels.end(), channel);
+        if(found == channels.end())
+        {
+            return false;
+        }
+        channels.erase(found);
+        return true;
+    }
+
+    //every channel subscribed to a pattern matching the topic, each once
+    std::vector<std::shared_ptr<NotificationChannel>> resolve(std::string_view topic) const
+    {
+        const auto levels = splitTopic(topic);
+        std::vector<std::shared_ptr<NotificationChannel>> matches, channels;
+        collect(root, levels, 0, matches);
+        for(auto& channel : matches)
+        {
+            if(std::find(channels.begin(), channels.end(), channel) == channels.end())
+            {
+                channels.push_back(std::move(channel));
+            }
+        }
+        return channels;
+    }
+
+private:
+    struct Node
+    {
+        std::map<std::string, std::unique_ptr<Node>, std::less<>> children;    //including "*"
+        std::vector<std::shared_ptr<NotificationChannel>> exact;                //pattern ends here
+        std::vector<std::shared_ptr<NotificationChannel>> subtree;              //pattern ends with # here
+    };
+
+    static void collect(const Node& node, const std::vector<std::string>& levels, size_t depth,
+                        std::vector<std::shared_ptr<NotificationChannel>>& channels)
+    {
+        if(depth == levels.size())
+        {
+            channels.insert(channels.end(), node.exact.begin(), node.exact.end());
+            return;
+        }
+        channels.insert(channels.end(), node.subtree.begin(), node.subtree.end());
+        for(std::string_view key : {std::string_view(levels[depth]), std::string_view("*")})
+        {
+            auto child = node.children.find(key);
+            if(child != node.children.end())
+            {
+                collect(*child->second, levels, depth + 1, channels);
+            }
+        }
+    }
+
+    Node root;
+};
+
+class TopicBus
+{
+public:
+    SymbolId addSymbol(const std::string& topic)
+    {
+        splitTopic(topic);
+        auto [it, added] = symbols.try_emplace(topic, static_cast<SymbolId>(topics.size()));
+        if(added)
+        {
+            topics.push_back(topic);
+            routes.emplace_back();
+        }
+        return it->second;
+    }
+
+    const std::string& topic(SymbolId symbol) const
+    {
+        return topics.at(symbol);
+    }
+
+    void subscribe(std::string_view pattern, std::shared_ptr<NotificationChannel> channel)
+    {
+        trie.subscribe(pattern, std::move(channel));
+        ++generation;
+    }
+
+    void unsubscribe(std::string_view pattern, const std::shared_ptr<NotificationChannel>& channel)
+    {
+        if(trie.unsubscribe(pattern, channel))
+        {
+            ++generation;
+        }
+    }
+
+    void publish(SymbolId symbol, double value)
+    {
+        auto& route = routes.at(symbol);
+        if(route.generation != generation)
+        {
+            route.channels = trie.resolve(topics[symbol]);
+            route.generation = generation;
+            ++resolutions;
+        }
+        for(auto& channel : route.channels)
+        {
+            channel->notify(topics[symbol], value);
+        }
+    }
+
+    //how many times a route had to be resolved through the trie
+    size_t getResolutions() const { return resolutions; }
+
+private:
+    struct Route
+    {
+        std::uint64_t generation = 0;
+        std::vector<std::shared_ptr<NotificationChannel>> channels;
+    };
+
+    TopicTrie trie;
+    std::unordered_map<std::string, SymbolId> symbols;
+    std::vector<std::string> topics;        //indexed by SymbolId
+    std::vector<Route> routes;              //indexed by SymbolId
+    std::uint64_t generation = 1;
+    size_t resolutions = 0;
+};
+
+class Stock
+{
+private:
+    TopicBus& bus;
+    const SymbolId symbol;
+    double value;
+public:
+    Stock(TopicBus& topicBus, const std::string& topic) : bus(topicBus), symbol(topicBus.addSymbol(topic)) {}
+
+    void valueChanged()
+    {
+        bus.publish(symbol, value);
+    }
+
+    void setValue(double newValue)
+    {
+        //just for test purposes
+        value = newValue;
+        valueChanged();
+    }
+};
+
+TEST_CASE("Channels subscribe to topics")
+{
+    TopicBus bus;
+    Stock moto(bus, "EQ.US.MOTO");
+    Stock nokia(bus, "EQ.FI.NOKIA");
+
+    bus.subscribe("EQ.US.*", std::make_shared<LcdScreen>());
+    bus.subscribe("EQ.#", std::make_shared<SmsNotification>());
+
+    moto.setValue(1.0);
+    nokia.setValue(5.1);
+}
+
+struct RecordingChannel : public NotificationChannel
+{
+    void notify(std::string_view topic, double value) override
+    {
+        topics.emplace_back(topic);
+    }
+    std::vector<std::string> topics;
+};
+
+TEST_CASE("Wildcards match one level, # matches the rest")
+{
+    TopicBus bus;
+    auto usEquities = std::make_shared<RecordingChannel>();
+    auto anyMoto = std::make_shared<RecordingChannel>();
+    auto equities = std::make_shared<RecordingChannel>();
+    auto moto = std::make_shared<RecordingChannel>();
+    bus.subscribe("EQ.US.*", usEquities);
+    bus.subscribe("EQ.*.MOTO", anyMoto);
+    bus.subscribe("EQ.#", equities);
+    bus.subscribe("EQ.US.MOTO", moto);
+
+    for(const char* topic : {"EQ.US.MOTO", "EQ.DE.MOTO", "EQ.US.IBM", "EQ.US.IBM.PREF", "FX.EURUSD", "EQ"})
+    {
+        bus.publish(bus.addSymbol(topic), 1.0);
+    }
+
+    CHECK(usEquities->topics == std::vector<std::string>{"EQ.US.MOTO", "EQ.US.IBM"});
+    CHECK(anyMoto->topics == std::vector<std::string>{"EQ.US.MOTO", "EQ.DE.MOTO"});
+    CHECK(equities->topics == std::vector<std::string>{"EQ.US.MOTO", "EQ.DE.MOTO", "EQ.US.IBM", "EQ.US.IBM.PREF"});
+    CHECK(moto->topics == std::vector<std::string>{"EQ.US.MOTO"});
+}
+
+TEST_CASE("Channel matching several patterns is notified once")
+{
+    TopicBus bus;
+    auto channel = std::make_shared<RecordingChannel>();
+    bus.subscribe("EQ.#", channel);
+    bus.subscribe("EQ.US.*", channel);
+    bus.subscribe("EQ.US.MOTO", channel);
+
+    bus.publish(bus.addSymbol("EQ.US.MOTO"), 1.0);
+    CHECK(channel->topics.size() == 1);
+}
+
+TEST_CASE("Routes are resolved once per symbol until subscriptions change")
+{
+    TopicBus bus;
+    auto lcd = std::make_shared<RecordingChannel>();
+    auto sms = std::make_shared<RecordingChannel>();
+    bus.subscribe("EQ.US.*", lcd);
+    const auto moto = bus.addSymbol("EQ.US.MOTO");
+    const auto ibm = bus.addSymbol("EQ.US.IBM");
+
+    for(int i = 0; i < 1000; ++i)
+    {
+        bus.publish(moto, i);
+        bus.publish(ibm, i);
+    }
+    CHECK(bus.getResolutions() == 2);
+    CHECK(lcd->topics.size() == 2000);
+
+    bus.subscribe("EQ.US.MOTO", sms);
+    bus.publish(moto, 1.0);
+    bus.publish(moto, 2.0);
+    CHECK(bus.getResolutions() == 3);
+    CHECK(sms->topics.size() == 2);
+
+    bus.unsubscribe("EQ.US.*", lcd);
+    bus.publish(moto, 3.0);
+    bus.publish(ibm, 3.0);
+    CHECK(lcd->topics.size() == 2002);
+    CHECK(sms->topics.size() == 3);
+}
+
+TEST_CASE("Malformed patterns are rejected")
+{
+    TopicBus bus;
+    auto channel = std::make_shared<RecordingChannel>();
+    CHECK_THROWS_AS(bus.subscribe("EQ.#.MOTO", channel), const std::invalid_argument&);
+    CHECK_THROWS_AS(bus.subscribe("EQ..MOTO", channel), const std::invalid_argument&);
+    CHECK_THROWS_AS(bus.addSymbol("EQ.US."), const std::invalid_argument&);
+}
+
+}